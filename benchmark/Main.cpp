@@ -40,8 +40,7 @@ std::vector<T*> create_vector(size_t size)
 template <typename... Components>
 void emplace_entities(ecs::world& world, size_t size)
 {
-	for (size_t i = 0; i < size; ++i)
-		world.emplace_entity<Components...>();
+	world.emplace_entities<Components...>(size);
 }
 
 template <typename... Components>
@@ -101,6 +100,23 @@ void test_entity_add_component(ecs::world& world)
 	std::cout << "Done\n";
 }
 
+void test_component_migration(ecs::world& world)
+{
+	size_t added = 0, removed = 0;
+
+	Benchmarker::benchmark<1>("Adding component Five where (Three, Six)", [&]
+	{
+		added = world.add_component_where<Five, Three, Six>();
+	}, added);
+
+	Benchmarker::benchmark<1>("Removing component Five where (Three, Six)", [&]
+	{
+		removed = world.remove_component_where<Five, Three, Six>();
+	}, removed);
+
+	std::cout << " > Moved " << Benchmarker::format_count(added) << " and " << Benchmarker::format_count(removed) << " entities\n";
+}
+
 int main()
 {
 	setlocale(LC_CTYPE, "");
@@ -116,8 +132,8 @@ int main()
 	std::cout << "Filling comparison vectors with test components... ";
 	auto baseRaw0 = create_vector<std::array<Esteem::Zero, ecs::config::bucket_size>>(10'000'000 / ecs::config::bucket_size);
 	auto baseRaw2 = create_vector<std::array<Esteem::Two, ecs::config::bucket_size>>(30'000'000 / ecs::config::bucket_size);
-	auto baseBucket2 = create_vector<ecs::details::archetype_storage<Esteem::Two>::bucket>(30'000'000 / ecs::config::bucket_size);
-	auto baseBucket0 = create_vector<ecs::details::archetype_storage<Esteem::Zero>::bucket>(10'000'000 / ecs::config::bucket_size);
+	auto baseBucket2 = create_vector<ecs::details::component_row<Esteem::Two>>(30'000'000 / ecs::config::bucket_size);
+	auto baseBucket0 = create_vector<ecs::details::component_row<Esteem::Zero>>(10'000'000 / ecs::config::bucket_size);
 	std::cout << "Done\n";
 
 	std::cout << "Filling our world with entities and their components... ";
@@ -150,14 +166,14 @@ int main()
 			{
 				for (auto& bucket : baseBucket2)
 				{
-					for (Two& two : bucket->get<Two>()._elements)
+					for (Two& two : bucket->_elements)
 					{
 						two.data = _mm_mul_ps(two.data, a);
 						two.data = _mm_mul_ps(two.data, two.data);
 					}
 				}
 			},
-			baseBucket2.size() * std::size(**baseBucket2.data())
+			baseBucket2.size() * std::size(baseBucket2[0]->_elements)
 		},
 		Benchmarker::sub_run{ "ECS query", [&]
 			{
@@ -168,6 +184,19 @@ int main()
 					});
 			},
 			world.count<Two>()
+		},
+		Benchmarker::sub_run{ "ECS query_chunks", [&]
+			{
+				world.query_chunks([](size_t count, ecs::component_span<Two> two) -> void
+					{
+						for (size_t i = 0; i < count; ++i)
+						{
+							two[i].data = _mm_mul_ps(two[i].data, a);
+							two[i].data = _mm_mul_ps(two[i].data, two[i].data);
+						}
+					});
+			},
+			world.count<Two>()
 		}
 	);
 
@@ -182,19 +211,19 @@ int main()
 					}
 				}
 			},
-			baseBucket0.size() * std::size(**baseBucket0.data())
+			baseBucket0.size() * std::size(baseBucket0[0]->_elements)
 		},
 		Benchmarker::sub_run{ "ECS buckets", [&]
 			{
 				for (auto& bucket : baseBucket0)
 				{
-					for (Zero& zero : bucket->get<Zero>()._elements)
+					for (Zero& zero : bucket->_elements)
 					{
 						zero.data *= zero.data;
 					}
 				}
 			},
-			baseBucket0.size() * std::size(**baseBucket0.data())
+			baseBucket0.size() * std::size(baseBucket0[0]->_elements)
 		},
 		Benchmarker::sub_run{ "ECS query", [&]
 			{
@@ -205,6 +234,15 @@ int main()
 			},
 			world.count<Zero>()
 		},
+		Benchmarker::sub_run{ "ECS query_parallel", [&]
+			{
+				world.query_parallel([](Zero& zero) -> void
+					{
+						zero.data *= zero.data;
+					});
+			},
+			world.count<Zero>()
+		},
 		Benchmarker::sub_run{ "ECS query entity", [&]
 			{
 				world.query([](Zero& zero, ecs::entity) -> void
@@ -279,6 +317,7 @@ int main()
 
 	test_entity_erasure(world);
 	test_entity_add_component(world);
+	test_component_migration(world);
 
 	std::cout << '\n';
 	Benchmarker::print_results();
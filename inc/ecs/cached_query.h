@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <array>
+
+#include "config.h"
+#include "world.h"
+#include "details/query_func.h"
+
+namespace ecs
+{
+	// Query that remembers its matching archetypes, e.g.: `ecs::cached_query<Two, One, ecs::exclude<Three>> query(world);`
+	// Only archetypes created since the last call are checked, the rest is a plain walk over the matches.
+	// `_Args` lists the components the query functions may use, excludes only filter. Must not outlive its world.
+	template<typename... _Args>
+	class cached_query
+	{
+	private:
+		struct match
+		{
+			details::archetype_storage<>* _archetype;
+
+			// bucket offsets of the `_Args` components, 0 for excludes
+			std::array<uintptr_t, sizeof...(_Args)> _offsets;
+		};
+
+		world* _world;
+		std::vector<match> _matches;
+
+		// amount of the world's archetypes we've checked so far, archetypes are never removed
+		size_t _checked = 0;
+
+		template<typename _T>
+		static constexpr uintptr_t offset_of(const match& match);
+
+		template<typename _Func, typename... _Params>
+		void apply(const details::query_func<_Func, _Params...>& func, const config::mask_type& writes, uint32_t since);
+
+	public:
+		cached_query(world& world);
+
+		// Checks the archetypes created since the last update, done by `query` and `count` as well
+		void update();
+
+		template<typename _Func>
+		void query(_Func&& func);
+
+		// `changed<T>` and `added<T>` filters skip buckets that haven't been touched after `since`
+		template<typename _Func>
+		void query(uint32_t since, _Func&& func);
+
+		size_t count();
+
+		// Get the amount of matching archetypes
+		size_t size() const;
+	};
+}
+
+#include "cached_query.inl"
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "cached_query.h"
+
+#include <algorithm>
+
+namespace ecs
+{
+	template<typename... _Args>
+	inline cached_query<_Args...>::cached_query(world& world)
+		: _world(&world)
+	{
+		update();
+	}
+
+	template<typename... _Args>
+	template<typename _T>
+	inline __forceinline constexpr uintptr_t cached_query<_Args...>::offset_of(const match& match)
+	{
+		if constexpr (is_entity_v<_T>)
+			return 0;
+		else
+		{
+			static_assert(std::disjunction_v<std::is_same<_T, decay_change_filter_t<_Args>>...>, "Query function parameters must be part of the cached query's components");
+			return match._offsets[param_index<_T, decay_change_filter_t<_Args>...>::value];
+		}
+	}
+
+	template<typename... _Args>
+	inline void cached_query<_Args...>::update()
+	{
+		const size_t archetypeCount = _world->_archetype_indices.size();
+		for (; _checked < archetypeCount; ++_checked)
+		{
+			auto& archetype = *_world->_archetype_indices[_checked];
+
+			if (config::registry::template qualifies<_Args...>(archetype.component_mask()))
+			{
+				_matches.push_back({ &archetype, { (is_exclude_v<_Args>
+					? 0
+					: archetype.component_offset<config::registry::template index_of<decay_change_filter_t<decay_exclude_t<_Args>>>>())... } });
+			}
+		}
+	}
+
+	template<typename... _Args>
+	template<typename _Func, typename... _Params>
+	inline void cached_query<_Args...>::apply(const details::query_func<_Func, _Params...>& func, const config::mask_type& writes, uint32_t since)
+	{
+		for (auto& match : _matches)
+		{
+			auto& archetype = *match._archetype;
+
+			const std::array<uintptr_t, sizeof...(_Params)> position{ offset_of<_Params>(match)... };
+			const size_t bucketCount = archetype.bucket_count();
+
+			for (size_t b = 0; b < bucketCount; ++b)
+			{
+				if constexpr (has_change_filter_v<_Args...>)
+				{
+					if (!world::bucket_changed(archetype, b, since, ecs::pack<_Args...>()))
+						continue;
+				}
+
+				if (writes.any())
+					archetype.mark_changed(b, writes);
+
+				const size_t count = archetype.bucket_entity_count(b);
+				world::apply_to_bucket_entities(func, count, *archetype.get_buckets()[b], position, archetype.tombstones(b));
+			}
+		}
+	}
+
+	template<typename... _Args>
+	template<typename _Func>
+	inline void cached_query<_Args...>::query(_Func&& func)
+	{
+		query(_world->current_tick() - 1, std::forward<_Func>(func));
+	}
+
+	template<typename... _Args>
+	template<typename _Func>
+	inline void cached_query<_Args...>::query(uint32_t since, _Func&& func)
+	{
+		static_assert(!world::has_sparse(ecs::pack<_Args...>()), "Sparse components are only supported by `world::query` and `world::count`");
+		update();
+		apply(details::to_query_func(std::forward<_Func>(func)), world::write_mask(details::query_params_t<_Func>()), since);
+	}
+
+	template<typename... _Args>
+	inline size_t cached_query<_Args...>::count()
+	{
+		update();
+
+		size_t count = 0;
+		for (auto& match : _matches)
+			count += match._archetype->live_size();
+
+		return count;
+	}
+
+	template<typename... _Args>
+	inline size_t cached_query<_Args...>::size() const
+	{
+		return _matches.size();
+	}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <tuple>
+#include <cstddef>
+
+#include "config.h"
+#include "entity.h"
+#include "world.h"
+#include "details/thread_pool.h"
+
+namespace ecs
+{
+	// Records structural changes, e.g.: during a query, and applies them at once on `apply`.
+	// Commands of an entity are reduced to their net effect, so every entity is moved at most once,
+	// the moves are then grouped by source and target archetype.
+	// Not thread-safe, use one buffer per thread (see `details::thread_pool::participant()`) and `append` them.
+	// Commands are applied in the order of the pool tasks that recorded them (see `details::thread_pool::task_key()`),
+	// the result doesn't depend on which thread ran which task. Commands of a single task, or from outside the pool, keep their recording order.
+	class command_buffer
+	{
+	private:
+		enum class command_type : uint8_t
+		{
+			emplace,
+			erase,
+			add,
+			remove,
+		};
+
+		struct command
+		{
+			entity _entity;
+			command_type _type;
+			uint16_t _component;
+
+			// emplace: the mask of all its components
+			config::mask_type _mask;
+
+			// range in `_payloads`
+			uint32_t _payload_first;
+			uint32_t _payload_count;
+
+			// pool task that recorded the command
+			uint64_t _task;
+		};
+
+		// constructed component waiting to be relocated into its archetype
+		struct payload
+		{
+			void* _data;
+			size_t _component;
+		};
+
+		// net effect of all commands on a single entity
+		struct change
+		{
+			entity _entity;
+			details::archetype_storage<>* _source;
+			config::mask_type _target_mask;
+			bool _erase;
+
+			// range in `_pending`, components to install after the move
+			uint32_t _pending_first;
+			uint32_t _pending_count;
+		};
+
+		static constexpr size_t block_size = 16384;
+
+		std::vector<command> _commands;
+		std::vector<payload> _payloads;
+
+		// payloads are constructed in place and must not move, blocks are never reallocated
+		std::vector<std::unique_ptr<std::max_align_t[]>> _blocks;
+		size_t _block_used = block_size;
+
+		template<typename _Component, typename... _Args>
+		uint32_t emplace_payload(_Args&&... args);
+
+		void* allocate_payload(size_t size, size_t alignment);
+
+		void destroy_payload(payload& payload);
+
+		void apply_changes(world& world);
+
+		void apply_sparse(world& world, const command& command);
+
+		void apply_emplaces(world& world);
+
+	public:
+		command_buffer() = default;
+		command_buffer(command_buffer&&) = default;
+		command_buffer& operator=(command_buffer&&) = default;
+		~command_buffer();
+
+		template<typename... _Components>
+		void emplace_entity();
+
+		template<typename... _Components, typename = std::enable_if_t<(sizeof...(_Components) > 0)>>
+		void emplace_entity(_Components&&... move);
+
+		void erase_entity(entity entity);
+
+		template<typename _Component, typename... _Args, typename = std::enable_if_t<ecs::config::registry::template contains<_Component> && std::is_constructible_v<_Component, _Args...>>>
+		void add_entity_component(entity entity, _Args&&... args);
+
+		template<typename _Component, typename = std::enable_if_t<ecs::config::registry::template contains<_Component>>>
+		void remove_entity_component(entity entity);
+
+		// Moves all commands of `other` behind ours, `other` is left empty
+		void append(command_buffer&& other);
+
+		// Applies all commands to the world and clears the buffer
+		void apply(world& world);
+
+		bool empty() const;
+
+		size_t size() const;
+
+		void clear();
+	};
+}
+
+#include "command_buffer.inl"
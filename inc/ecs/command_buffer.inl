@@ -0,0 +1,447 @@
+#pragma once
+
+#include "command_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ecs
+{
+	inline command_buffer::~command_buffer()
+	{
+		clear();
+	}
+
+	inline void* command_buffer::allocate_payload(size_t size, size_t alignment)
+	{
+		size_t offset = (_block_used + alignment - 1) & ~(alignment - 1);
+
+		if (_blocks.empty() || offset + size > block_size)
+		{
+			// oversized payloads get a block of their own
+			const size_t bytes = std::max(size, block_size);
+			_blocks.emplace_back(new std::max_align_t[(bytes + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)]);
+			offset = 0;
+		}
+
+		_block_used = offset + size;
+		return reinterpret_cast<uint8_t*>(_blocks.back().get()) + offset;
+	}
+
+	template<typename _Component, typename... _Args>
+	inline uint32_t command_buffer::emplace_payload(_Args&&... args)
+	{
+		static_assert(alignof(_Component) <= alignof(std::max_align_t), "Component alignment is too big for the command buffer payload storage.");
+
+		void* data = allocate_payload(sizeof(_Component), alignof(_Component));
+		new (data) _Component(std::forward<_Args>(args)...);
+
+		_payloads.push_back({ data, config::registry::template index_of<_Component> });
+		return uint32_t(_payloads.size() - 1);
+	}
+
+	inline void command_buffer::destroy_payload(payload& payload)
+	{
+		if (payload._data && !config::registry::_component_relocatable[payload._component])
+			config::registry::_component_destruct[payload._component](payload._data);
+
+		payload._data = nullptr;
+	}
+
+	template<typename... _Components>
+	inline void command_buffer::emplace_entity()
+	{
+		static_assert(!(is_sparse_v<_Components> || ...), "Sparse components are not part of any archetype, add them with `add_entity_component`");
+
+		const uint32_t first = uint32_t(_payloads.size());
+		(emplace_payload<_Components>(), ...);
+
+		_commands.push_back({ entity(), command_type::emplace, 0, config::registry::template bit_mask_of<_Components...>, first, uint32_t(sizeof...(_Components)), details::thread_pool::task_key() });
+	}
+
+	template<typename... _Components, typename>
+	inline void command_buffer::emplace_entity(_Components&&... move)
+	{
+		static_assert(!(is_sparse_v<std::decay_t<_Components>> || ...), "Sparse components are not part of any archetype, add them with `add_entity_component`");
+
+		const uint32_t first = uint32_t(_payloads.size());
+		(emplace_payload<std::decay_t<_Components>>(std::forward<_Components>(move)), ...);
+
+		_commands.push_back({ entity(), command_type::emplace, 0, config::registry::template bit_mask_of<std::decay_t<_Components>...>, first, uint32_t(sizeof...(_Components)), details::thread_pool::task_key() });
+	}
+
+	inline void command_buffer::erase_entity(entity entity)
+	{
+		_commands.push_back({ entity, command_type::erase, 0, config::mask_type(), 0, 0, details::thread_pool::task_key() });
+	}
+
+	template<typename _Component, typename... _Args, typename>
+	inline void command_buffer::add_entity_component(entity entity, _Args&&... args)
+	{
+		const uint32_t payload = emplace_payload<_Component>(std::forward<_Args>(args)...);
+		_commands.push_back({ entity, command_type::add, config::registry::template index_of<_Component>, config::mask_type(), payload, 1, details::thread_pool::task_key() });
+	}
+
+	template<typename _Component, typename>
+	inline void command_buffer::remove_entity_component(entity entity)
+	{
+		_commands.push_back({ entity, command_type::remove, config::registry::template index_of<_Component>, config::mask_type(), 0, 0, details::thread_pool::task_key() });
+	}
+
+	inline void command_buffer::append(command_buffer&& other)
+	{
+		const uint32_t payloadOffset = uint32_t(_payloads.size());
+
+		for (auto& command : other._commands)
+		{
+			command._payload_first += payloadOffset;
+			_commands.push_back(command);
+		}
+
+		_payloads.insert(_payloads.end(), other._payloads.begin(), other._payloads.end());
+
+		if (!other._blocks.empty())
+		{
+			_blocks.insert(_blocks.end(), std::make_move_iterator(other._blocks.begin()), std::make_move_iterator(other._blocks.end()));
+			_block_used = other._block_used;
+		}
+
+		other._commands.clear();
+		other._payloads.clear();
+		other._blocks.clear();
+		other._block_used = block_size;
+	}
+
+	inline void command_buffer::apply(world& world)
+	{
+		// appended per-thread buffers hold their tasks in any order
+		const auto byTask = [](const command& a, const command& b) { return a._task < b._task; };
+		if (!std::is_sorted(_commands.begin(), _commands.end(), byTask))
+			std::stable_sort(_commands.begin(), _commands.end(), byTask);
+
+		apply_changes(world);
+		apply_emplaces(world);
+		clear();
+	}
+
+	inline void command_buffer::apply_changes(world& world)
+	{
+		// all commands of an entity next to each other, in recording order
+		std::vector<uint32_t> order;
+		order.reserve(_commands.size());
+
+		for (uint32_t i = 0; i < _commands.size(); ++i)
+		{
+			if (_commands[i]._type != command_type::emplace)
+				order.push_back(i);
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+		{
+			return _commands[a]._entity.get_id() < _commands[b]._entity.get_id();
+		});
+
+		std::vector<change> changes;
+		std::vector<uint32_t> pending;
+
+		// reduce the commands of each entity to a single change
+		for (size_t i = 0; i < order.size(); )
+		{
+			const uint32_t id = _commands[order[i]]._entity.get_id();
+
+			entity target;
+			details::entity_target reference;
+			config::mask_type mask;
+			bool erase = false;
+
+			const uint32_t pendingFirst = uint32_t(pending.size());
+
+			for (; i < order.size() && _commands[order[i]]._entity.get_id() == id; ++i)
+			{
+				auto& command = _commands[order[i]];
+
+				// commands on erased entities or outdated versions are dropped
+				if (erase || !world.get_entity(command._entity, reference))
+				{
+					for (uint32_t p = 0; p < command._payload_count; ++p)
+						destroy_payload(_payloads[command._payload_first + p]);
+
+					continue;
+				}
+
+				if (!target.valid())
+				{
+					target = command._entity;
+					mask = world.archetype_of(reference).component_mask();
+				}
+
+				// sparse components don't move the entity, apply them in recording order right away
+				if (command._type != command_type::erase && config::registry::_component_sparse[command._component])
+				{
+					apply_sparse(world, command);
+					continue;
+				}
+
+				switch (command._type)
+				{
+				case command_type::erase:
+					erase = true;
+
+					for (uint32_t p = pendingFirst; p < pending.size(); ++p)
+						destroy_payload(_payloads[pending[p]]);
+
+					pending.resize(pendingFirst);
+					break;
+
+				case command_type::add:
+					if (mask.test(command._component))
+						destroy_payload(_payloads[command._payload_first]);
+					else
+					{
+						mask.set(command._component);
+						pending.push_back(command._payload_first);
+					}
+					break;
+
+				case command_type::remove:
+					if (mask.test(command._component))
+					{
+						mask.reset(command._component);
+
+						// an earlier add of this component never has to happen
+						for (uint32_t p = pendingFirst; p < pending.size(); ++p)
+						{
+							if (_payloads[pending[p]]._component == command._component)
+							{
+								destroy_payload(_payloads[pending[p]]);
+								pending.erase(pending.begin() + p);
+								break;
+							}
+						}
+					}
+					break;
+
+				default:
+					break;
+				}
+			}
+
+			if (target.valid() && (erase || mask != world.archetype_of(reference).component_mask() || pending.size() != pendingFirst))
+				changes.push_back({ target, &world.archetype_of(reference), mask, erase, pendingFirst, uint32_t(pending.size()) - pendingFirst });
+		}
+
+		// all erasures as a single batch first, every archetype fills its holes from the tail once
+		std::vector<std::pair<details::entity_target, uint32_t>> erased;
+		for (auto& change : changes)
+		{
+			if (change._erase)
+				erased.emplace_back(world._entity_mapping[change._entity.get_id()], change._entity.get_id());
+		}
+
+		if (!erased.empty())
+		{
+			world.erase_targets(erased);
+			changes.erase(std::remove_if(changes.begin(), changes.end(), [](const change& change) { return change._erase; }), changes.end());
+		}
+
+		// group by source and target archetype, highest index first: every hole is then filled by an entity we don't have to touch again
+		std::sort(changes.begin(), changes.end(), [&](const change& a, const change& b)
+		{
+			// by index, the order must not depend on where archetypes happen to be allocated
+			if (a._source != b._source)
+				return a._source->archetype_index() < b._source->archetype_index();
+
+			if (a._target_mask != b._target_mask)
+				return a._target_mask < b._target_mask;
+
+			return world._entity_mapping[a._entity.get_id()]._index > world._entity_mapping[b._entity.get_id()]._index;
+		});
+
+		details::archetype_storage<>* source = nullptr;
+		details::archetype_storage<>* target = nullptr;
+		const details::archetype_edge* edge = nullptr;
+		details::archetype_edge transientEdge;
+
+		for (auto& change : changes)
+		{
+			// indices change while we move, always use the current one
+			auto& mapping = world._entity_mapping[change._entity.get_id()];
+			const uint32_t index = mapping._index;
+			const config::mask_type& sourceMask = change._source->component_mask();
+
+			details::archetype_storage<>::bucket* bucket;
+			details::archetype_storage<>* destination;
+			uint32_t newIndex;
+
+			if (change._target_mask == sourceMask)
+			{
+				newIndex = index;
+				bucket = change._source->get_buckets()[change._source->bucket_index(index)];
+				destination = change._source;
+			}
+			else
+			{
+				if (change._source != source || target == nullptr || change._target_mask != target->component_mask())
+				{
+					source = change._source;
+					target = &world.runtime_emplace_archetype(change._target_mask);
+
+					// single component difference can use the cached edges
+					const config::mask_type difference = sourceMask ^ change._target_mask;
+					if (difference.count() == 1)
+					{
+						const size_t component = difference.first();
+						edge = &world.emplace_archetype_edge(*source, component, change._target_mask.test(component));
+					}
+					else
+					{
+						transientEdge = source->make_edge(~size_t(0), *target);
+						edge = &transientEdge;
+					}
+				}
+
+				uint32_t replaced;
+				std::tie(newIndex, bucket, replaced) = source->move(index, *edge);
+
+				mapping.move(newIndex, *target);
+
+				if (replaced != entity::npos)
+					world._entity_mapping[replaced].move(index);
+
+				destination = target;
+			}
+
+			// install the added components
+			const uintptr_t components = uintptr_t(bucket);
+			const size_t element = destination->element_index(newIndex);
+
+			for (uint32_t p = 0; p < change._pending_count; ++p)
+			{
+				auto& payload = _payloads[pending[change._pending_first + p]];
+				const size_t component = payload._component;
+				const size_t size = config::registry::_component_size[component];
+				void* slot = reinterpret_cast<void*>(components + destination->component_offset(component) + element * size);
+
+				// removed and added again, replace the moved value
+				if (sourceMask.test(component))
+				{
+					if (!config::registry::_component_relocatable[component])
+						config::registry::_component_destruct[component](slot);
+
+					destination->mark_changed(destination->bucket_index(newIndex), config::mask_type::bit(component));
+				}
+
+				if (config::registry::_component_relocatable[component])
+					std::memcpy(slot, payload._data, size);
+				else
+					config::registry::_component_relocate[component](slot, payload._data);
+
+				payload._data = nullptr;
+			}
+		}
+	}
+
+	inline void command_buffer::apply_sparse(world& world, const command& command)
+	{
+		auto& set = world.sparse_set_of(command._component);
+		const uint32_t id = command._entity.get_id();
+
+		if (command._type == command_type::remove)
+			set.erase(id);
+		else if (set.contains(id))
+			destroy_payload(_payloads[command._payload_first]);
+		else
+		{
+			auto& payload = _payloads[command._payload_first];
+			void* slot = set.allocate(id);
+
+			// tags have no slot
+			if (slot == nullptr)
+				destroy_payload(payload);
+			else
+			{
+				if (config::registry::_component_relocatable[payload._component])
+					std::memcpy(slot, payload._data, config::registry::_component_size[payload._component]);
+				else
+					config::registry::_component_relocate[payload._component](slot, payload._data);
+
+				payload._data = nullptr;
+			}
+		}
+	}
+
+	inline void command_buffer::apply_emplaces(world& world)
+	{
+		std::vector<uint32_t> order;
+
+		for (uint32_t i = 0; i < _commands.size(); ++i)
+		{
+			if (_commands[i]._type == command_type::emplace)
+				order.push_back(i);
+		}
+
+		// same archetypes next to each other, they then fill up bucket by bucket
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+		{
+			return _commands[a]._mask < _commands[b]._mask;
+		});
+
+		details::archetype_storage<>* archetype = nullptr;
+
+		for (uint32_t i : order)
+		{
+			auto& command = _commands[i];
+
+			if (archetype == nullptr || archetype->component_mask() != command._mask)
+				archetype = &world.runtime_emplace_archetype(command._mask);
+
+			auto [entity, mapping] = world.allocate_entity();
+			auto [index, bucket] = archetype->allocate(entity);
+			mapping.set(archetype, index);
+
+			const uintptr_t components = uintptr_t(bucket);
+			const size_t element = archetype->element_index(index);
+
+			for (uint32_t p = 0; p < command._payload_count; ++p)
+			{
+				auto& payload = _payloads[command._payload_first + p];
+				const size_t component = payload._component;
+				const size_t size = config::registry::_component_size[component];
+				void* slot = reinterpret_cast<void*>(components + archetype->component_offset(component) + element * size);
+
+				if (config::registry::_component_relocatable[component])
+					std::memcpy(slot, payload._data, size);
+				else
+					config::registry::_component_relocate[component](slot, payload._data);
+
+				payload._data = nullptr;
+			}
+		}
+	}
+
+	inline bool command_buffer::empty() const
+	{
+		return _commands.empty();
+	}
+
+	inline size_t command_buffer::size() const
+	{
+		return _commands.size();
+	}
+
+	inline void command_buffer::clear()
+	{
+		for (auto& payload : _payloads)
+			destroy_payload(payload);
+
+		_commands.clear();
+		_payloads.clear();
+
+		// keep a single block around for the next round of commands
+		if (!_blocks.empty())
+		{
+			_blocks.resize(1);
+			_block_used = 0;
+		}
+	}
+}
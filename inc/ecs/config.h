@@ -1,19 +1,36 @@
 #pragma once
 
 #ifndef ECS_BUCKET_SIZE
-#define ECS_BUCKET_SIZE 64
+#define ECS_BUCKET_SIZE 1024
+#endif
+
+#ifndef ECS_BUCKET_BYTES
+#define ECS_BUCKET_BYTES 16384
+#endif
+
+#ifndef ECS_THREAD_COUNT
+#define ECS_THREAD_COUNT 0
 #endif
 
 namespace ecs::config
 {
-	// Amount of entities (their components) that will be stored in each bucket
+	// Maximum amount of entities (their components) that will be stored in each bucket
 	constexpr size_t bucket_size = ECS_BUCKET_SIZE;
 
+	// Byte budget of a bucket, each archetype stores as many entities per bucket as fit in it (a power of 2, up to `bucket_size`).
+	// Wide archetypes get fewer entities per bucket, narrow ones more, e.g.: tune to the L1/L2 cache or page size.
+	constexpr size_t bucket_bytes = ECS_BUCKET_BYTES;
+
+	// Minimum alignment of every bucket and each of its columns, a cache line
+	constexpr size_t bucket_alignment = 64;
+
 	// Entities use 32 bits to define the world they belong to and the reuse version, inclusive.
 	// define how much of these bits are reserved for the world; 
 	// 8:
 	//   - Supports up to 256 worlds.
-	//   - 16,777,216 reuses of the id before any false positives could theoretically happen.
+	//   - 24 version bits in the entity, only the lower 16 are kept in the entity mapping and compared:
+	//     65,536 reuses of the id before any false positives could theoretically happen,
+	//     freed ids are reused most recent first so a single id can get there quickly.
 	constexpr size_t world_bits = 8;
 
 	// Worlds are saved as pointers and can be inherited, put to false to store them in an array directly.
@@ -25,7 +42,11 @@ namespace ecs::config
 	// If > 0 then archetypes are saved in a fixed sized array in the world object, otherwise they are stored with std::vector.
 	constexpr size_t archetype_fixed_vector = 0;
 
+	// Amount of threads (including the calling thread) used by parallel queries, 0 will use std::thread::hardware_concurrency().
+	constexpr size_t thread_count = ECS_THREAD_COUNT;
+
 	// Checks
 	static_assert(bucket_size != 0 && (bucket_size & (bucket_size - 1)) == 0, "bucket_size must be a power of 2");
+	static_assert(bucket_alignment != 0 && (bucket_alignment & (bucket_alignment - 1)) == 0, "bucket_alignment must be a power of 2");
 	static_assert(world_fixed_vector < (1 << world_bits), "world_fixed_vector must fit within an integer of size world_bits");
 }
@@ -14,4 +14,7 @@ namespace ecs::config
 {
 	// The global registry, should be (a sub-class of) ecs::registry<...>
 	typedef ECS_REGISTRY_CLASS registry;
+
+	// Component mask of the global registry
+	typedef registry::mask_type mask_type;
 }
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+namespace ecs::details
+{
+	// Open-addressing (linear probing) map of component masks to archetypes.
+	// Entries are never removed, which keeps probing simple and slots stable until the next growth.
+	template <typename _Key, typename _Value>
+	class archetype_map
+	{
+	private:
+		struct slot_t
+		{
+			_Key _key{};
+			_Value* _value = nullptr;
+		};
+
+		std::vector<slot_t> _slots;
+		size_t _size = 0;
+		size_t _shift = 64;
+
+		size_t home(const _Key& key) const;
+
+		void grow();
+
+	public:
+		static constexpr size_t npos = ~size_t(0);
+
+		size_t size() const;
+
+		// returns the slot of the key or npos, slots stay valid until the next insert
+		size_t find_slot(const _Key& key) const;
+
+		_Value* find(const _Key& key) const;
+
+		// O(1) check of a previously returned slot, e.g.: a per call-site cache, returns nullptr if it's no longer a match
+		_Value* at_slot(size_t slot, const _Key& key) const;
+
+		// inserts a new key, which must not be present already, returns its slot
+		size_t insert(const _Key& key, _Value* value);
+
+		void clear();
+	};
+
+	template <typename _Key, typename _Value>
+	inline size_t archetype_map<_Key, _Value>::home(const _Key& key) const
+	{
+		// fibonacci hashing, spreads the few set bits of a mask over the upper bits
+		if constexpr (std::is_integral_v<_Key>)
+			return size_t((uint64_t(key) * 0x9E3779B97F4A7C15ull) >> _shift);
+		else
+			return size_t((key.hash() * 0x9E3779B97F4A7C15ull) >> _shift);
+	}
+
+	template <typename _Key, typename _Value>
+	inline void archetype_map<_Key, _Value>::grow()
+	{
+		std::vector<slot_t> old = std::move(_slots);
+
+		const size_t capacity = old.empty() ? 16 : old.size() * 2;
+		_slots.assign(capacity, slot_t());
+		_shift = 64;
+		for (size_t c = capacity; c > 1; c >>= 1)
+			--_shift;
+
+		const size_t mask = capacity - 1;
+		for (auto& slot : old)
+		{
+			if (slot._value)
+			{
+				size_t i = home(slot._key);
+				while (_slots[i]._value)
+					i = (i + 1) & mask;
+
+				_slots[i] = slot;
+			}
+		}
+	}
+
+	template <typename _Key, typename _Value>
+	inline size_t archetype_map<_Key, _Value>::size() const
+	{
+		return _size;
+	}
+
+	template <typename _Key, typename _Value>
+	inline size_t archetype_map<_Key, _Value>::find_slot(const _Key& key) const
+	{
+		if (_slots.empty())
+			return npos;
+
+		const size_t mask = _slots.size() - 1;
+		for (size_t i = home(key); _slots[i]._value; i = (i + 1) & mask)
+		{
+			if (_slots[i]._key == key)
+				return i;
+		}
+
+		return npos;
+	}
+
+	template <typename _Key, typename _Value>
+	inline _Value* archetype_map<_Key, _Value>::find(const _Key& key) const
+	{
+		size_t slot = find_slot(key);
+		return slot != npos ? _slots[slot]._value : nullptr;
+	}
+
+	template <typename _Key, typename _Value>
+	inline _Value* archetype_map<_Key, _Value>::at_slot(size_t slot, const _Key& key) const
+	{
+		return slot < _slots.size() && _slots[slot]._key == key
+			? _slots[slot]._value
+			: nullptr;
+	}
+
+	template <typename _Key, typename _Value>
+	inline size_t archetype_map<_Key, _Value>::insert(const _Key& key, _Value* value)
+	{
+		// keep the load factor at or below 0.5, probe sequences stay short
+		if ((_size + 1) * 2 > _slots.size())
+			grow();
+
+		const size_t mask = _slots.size() - 1;
+		size_t i = home(key);
+		while (_slots[i]._value)
+			i = (i + 1) & mask;
+
+		_slots[i]._key = key;
+		_slots[i]._value = value;
+		++_size;
+
+		return i;
+	}
+
+	template <typename _Key, typename _Value>
+	inline void archetype_map<_Key, _Value>::clear()
+	{
+		_slots.clear();
+		_size = 0;
+		_shift = 64;
+	}
+}
@@ -3,15 +3,13 @@
 #include <vector>
 #include <tuple>
 #include <utility>
+#include <algorithm>
 #include <cstdlib>
 
 #include "../config_registry.h"
 #include "../utils.h"
 #include "component_matrix.h"
-
-#ifndef ECS_ONLY_USE_RUNTIME_REMOVE_FUNC
-#define ECS_ONLY_USE_RUNTIME_REMOVE_FUNC true
-#endif
+#include "bucket_pool.h"
 
 namespace ecs
 {
@@ -20,151 +18,259 @@ namespace ecs
 		template <typename... _Components>
 		class archetype_storage;
 
+		// Location of an entity, packed in 8 bytes as there's one for every entity id ever allocated
 		struct entity_target
 		{
-			uint32_t _version;
 			uint32_t _index;
-			archetype_storage<>* _archetype;
 
-			static constexpr archetype_storage<>* npos = nullptr;
+			// index of the archetype in its world, see `archetype_storage::archetype_index()`
+			uint16_t _archetype;
 
-			void set(archetype_storage<>* archetype, uint32_t index)
-			{
-				this->_archetype = archetype;
-				this->_index = index;
-			}
+			// lower 16 bits of the entity version
+			uint16_t _version;
+
+			static constexpr uint16_t npos = ~uint16_t(0);
+
+			void set(archetype_storage<>* archetype, uint32_t index);
 
 			void move(uint32_t index)
 			{
 				this->_index = index;
 			}
 
-			void move(uint32_t index, archetype_storage<>& storage)
-			{
-				this->_index = index;
-				this->_archetype = &storage;
-			}
+			void move(uint32_t index, archetype_storage<>& storage);
 
 			void invalidate()
 			{
 				_version++;
 				_index = 0;
-				_archetype = nullptr;
+				_archetype = npos;
 			}
 		};
 
+		static_assert(sizeof(entity_target) == 8, "entity_target should be of byte size 8");
+
+		// Copy of a single component column between two buckets, offsets are in bytes from the start of the component data
+		struct column_copy
+		{
+			uint32_t _from_offset;
+			uint32_t _to_offset;
+			uint16_t _size;
+			uint16_t _component;
+			bool _relocatable;
+		};
+
+		// Cached transition to the archetype with one component added or removed
+		struct archetype_edge
+		{
+			size_t _component;
+			archetype_storage<>* _target;
+
+			// columns both archetypes have in common, the relocatable ones first
+			std::vector<column_copy> _copies;
+
+			// amount of `_copies` that are moved with a memcpy
+			size_t _relocatable_copies = 0;
+
+			// columns only the source has (remove edges) that need to be destroyed, relocatable ones are left as is
+			std::vector<column_copy> _drops;
+		};
+
 		template <typename... _Components>
 		class archetype_storage
 		{
 		public:
-			class alignas(config::bucket_size) bucket
+			// Raw bucket memory, the entity ids followed by a column per component, both sized by the archetype's `bucket_capacity()`.
+			// Offsets are in bytes from the start of the bucket, see `component_offset`.
+			class alignas(config::bucket_alignment) bucket
 			{
 				friend class archetype_storage<_Components...>;
-			public:
-				typedef component_matrix<_Components...> ComponentData;
 
 			private:
-				entity _to_entity[config::bucket_size];
-				alignas(8) ComponentData _component_data;
+				constexpr entity* entities();
 
 			public:
-				static constexpr size_t max_size = config::bucket_size;
-
-				// returns max size, not currently stored entities
-				static constexpr size_t size();
-
-				constexpr ComponentData& components();
-
-				constexpr const ComponentData& components() const;
-
 				constexpr const entity& get_entity(size_t index) const;
 
 				template<typename _T>
-				constexpr component_row<_T>& get();
+				constexpr component_row<_T>& get_unsafe(size_t offset);
 
 				template<typename _T>
-				constexpr const component_row<_T>& get() const;
+				constexpr _T& get_unsafe(size_t offset, size_t index);
+			};
 
-				template<typename _T>
-				constexpr _T& get(size_t index);
+		private:
+			config::mask_type _component_mask;
 
-				template<typename _T>
-				constexpr component_row<_T>& get_unsafe(size_t offset);
+			// byte offset of each column from the start of a bucket
+			uint32_t _component_offsets[ecs::config::registry::count];
 
-				template<typename _T>
-				constexpr _T& get_unsafe(size_t offset, size_t index);
+			// entities per bucket, a power of 2 fitting the archetype in `config::bucket_bytes`
+			uint32_t _bucket_capacity = uint32_t(config::bucket_size);
+			uint8_t _bucket_shift = 0;
 
-				template<size_t _Index>
-				constexpr component_row<std::tuple_element_t<_Index, std::tuple<_Components...>>>& get();
+			size_t _entity_count = 0;
+			std::vector<bucket*> _buckets;
 
-				template<size_t _Index>
-				constexpr const component_row<std::tuple_element_t<_Index, std::tuple<_Components...>>>& get() const;
+			// memory of `_buckets`, in order
+			bucket_pool _pool;
 
-				static void* operator new(size_t count);
-				static void operator delete(void* ptr);
+			// pool capacity kept by `reserve`, even when it's unused
+			size_t _reserved_buckets = 0;
 
-				static void* operator new(size_t count, size_t custom_size) { return operator new(custom_size); }
-				static void operator delete(void* ptr, size_t custom_size) { operator delete(ptr); }
-			};
+			// bytes of a single bucket, `_bucket_capacity` entities and their components
+			size_t _bucket_size = 0;
 
-		private:
-			size_t _component_mask = 0;
+			// alignment of a bucket, at least that of its most aligned component
+			size_t _bucket_alignment = config::bucket_alignment;
 
-			// stored as `offset / _Size` removing unused precision
-			uint16_t _component_offsets[ecs::config::registry::count];
+			// all columns of this archetype, `_from_offset == _to_offset`: relocatable columns, then the others, tags are put last
+			std::vector<column_copy> _columns;
 
-			size_t _entity_count = 0;
-			std::vector<std::unique_ptr<bucket>> _buckets;
+			// amount of columns moved with a memcpy, the first ones in `_columns`
+			size_t _relocatable_columns = 0;
 
-			size_t _bucket_size;
-			// uint32_t _bucket_align; // we are already aligned by config::bucket_size
+			// amount of columns with storage, i.e.: `_columns` without the tags
+			size_t _storage_columns = 0;
 
-			uint32_t remove(size_t index);
+			// index of each component in `_columns`
+			uint16_t _component_columns[ecs::config::registry::count];
 
-#if !ECS_ONLY_USE_RUNTIME_REMOVE_FUNC
-			decltype(&archetype_storage::remove) _removeOperation; // runtime version is faster in our test cases
-#endif
+			// change tracking, per bucket: a changed tick for each column followed by an added tick for each column
+			std::vector<uint32_t> _ticks;
+			uint32_t _tick = 0;
 
-			template<typename _T>
-			static void destruct(_T& object);
+			uint16_t _archetype_index = entity_target::npos;
 
-			template<typename _T>			
-			static void move_and_destruct(_T& to, _T&& from);
+			std::vector<archetype_edge> _add_edges;
+			std::vector<archetype_edge> _remove_edges;
 
-			template<typename... _Cs, typename _MoveFunc, typename _RemoveFunc>
-			uint32_t remove_internal(size_t index, _MoveFunc move_func, _RemoveFunc remove_func);
+			// stable erase marks erased slots dead instead of filling them with the last entity, see `set_stable_erase`
+			bool _stable_erase = false;
 
-			template<typename _T, typename _ComponentMatrix>
-			void initialize_component_offset();
+			// a bit per slot for each bucket, only set for dead slots below `_entity_count`
+			std::vector<uint64_t> _tombstones;
+
+			// dead slots per bucket, and in total
+			std::vector<uint32_t> _bucket_tombstones;
+			size_t _tombstone_count = 0;
+
+			// progress of the incremental compaction, the slots in [write, read) are all dead
+			size_t _compact_write = 0;
+			size_t _compact_read = 0;
 
 			template<typename... _Cs>
 			uint32_t emplace_internal(entity entity, _Cs&&... move);
 
+			void initialize_columns();
+
+			// assigns the column offsets for `capacity` entities per bucket, returns the bucket size in bytes.
+			// Every column starts at a multiple of its component's alignment or the cache line, whichever is larger
+			size_t initialize_layout(size_t capacity);
+
+			// appends a bucket of `_bucket_size` bytes, only its entities are constructed
+			bucket* allocate_bucket();
+
+			// returns the last bucket to the pool once it's no longer used,
+			// slabs are freed only while less than half of the remaining pool is used, and never below `reserve`
+			void shrink_buckets();
+
+			// moves the last entity into the (destroyed) slot at `index`, returns its id or `entity::npos` if `index` was the last
+			uint32_t fill_hole(size_t index);
+
+			// frees the (destroyed) slot at `index`: marks it dead with stable erase, fills the hole otherwise. Returns the entity that took its place
+			uint32_t release_slot(size_t index);
+
+			// marks the (destroyed) slot dead, dead slots at the end are dropped right away
+			void bury(size_t index);
+
+			// 64 bit words of tombstones per bucket
+			size_t tombstone_words() const;
+
+			void set_tombstone(size_t index);
+
+			void clear_tombstone(size_t index);
+
+			// relocates `count` consecutive entities' components between buckets (or within one, ranges mustn't overlap),
+			// a single memcpy per relocatable column, leaving the source slots destroyed
+			void relocate_rows(bucket* to, size_t toIndex, bucket* from, size_t fromIndex, size_t count);
+
+			// relocates `count` consecutive entities' components to the edge's target, destroying the columns it doesn't have
+			void relocate_rows(const archetype_edge& edge, bucket* to, size_t toIndex, bucket* from, size_t fromIndex, size_t count);
+
+			// destroys the components of `count` consecutive entities in the bucket
+			void destruct_rows(bucket* _bucket, size_t index, size_t count);
+
+			// carries the ticks of entities moved along the edge into the target bucket, the added column is stamped as new
+			void carry_ticks(const archetype_edge& edge, size_t toBucketIndex, size_t toElementIndex, size_t fromBucketIndex) const;
+
+			uint32_t* bucket_ticks(size_t bucketIndex);
+
+			const uint32_t* bucket_ticks(size_t bucketIndex) const;
+
+			// grows the ticks to include the bucket, new buckets start at tick 0
+			uint32_t* allocate_ticks(size_t bucketIndex);
+
+			// marks all columns of the bucket as added at the current tick
+			void stamp_added(size_t bucketIndex);
+
+			// carries the ticks of an entity that moved from one bucket to the other within this archetype
+			void merge_ticks(size_t toBucketIndex, size_t fromBucketIndex);
+
 		public:
+			// Lower bound of the bucket capacity, for very wide archetypes
+			static constexpr size_t min_bucket_capacity = std::min<size_t>(16, config::bucket_size);
+
 			archetype_storage();
 
 			template<typename... _Cs>
 			void initialize();
 
 #pragma region runtime methods
-			template<typename... _Cs>
-			void runtime_initialize(size_t mask, ecs::pack<_Cs...>);
+			void runtime_initialize(const config::mask_type& mask);
 
-			template<typename... _Cs>
-			std::tuple<uint32_t, bucket*, uint32_t> runtime_move(size_t index, archetype_storage<>& new_storage, ecs::pack<_Cs...>);
-			
-			template<typename... _Cs>
-			uint32_t runtime_remove_internal(size_t index, ecs::pack<_Cs...>);
+			// returns the cached edge, nullptr if it hasn't been created yet
+			const archetype_edge* find_edge(size_t component, bool add) const;
+
+			const archetype_edge& emplace_edge(size_t component, bool add, archetype_storage<>& target);
 
-			uint32_t runtime_remove(size_t index);
+			// creates an uncached edge to any archetype, e.g.: for multiple component changes at once
+			archetype_edge make_edge(size_t component, archetype_storage<>& target) const;
+
+			// moves the entity along the edge, returns { new index, new bucket, entity that took its place }
+			std::tuple<uint32_t, bucket*, uint32_t> move(size_t index, const archetype_edge& edge);
+
+			// moves all entities along the edge bucket by bucket, leaving this archetype empty. Components are copied as ranges,
+			// `placed(bucket, first index, count)` is called for every range appended to the target, e.g.: to construct an added component
+			template<typename _Placed>
+			void move_all(const archetype_edge& edge, _Placed&& placed);
 
 			template<typename... _Cs>
 			uint32_t runtime_emplace(entity entity, ecs::pack<_Cs...>);
 #pragma endregion
 
+			// Slots in use, including the dead ones of stable erase archetypes, i.e.: the range to iterate
 			size_t size() const;
 
-			size_t component_mask() const;
+			// Entities alive, `size()` without the dead slots
+			size_t live_size() const;
+
+			// Entities per bucket
+			size_t bucket_capacity() const;
+
+			// Bucket of the entity at `index`
+			size_t bucket_index(size_t index) const;
+
+			// Position of the entity at `index` within its bucket
+			size_t element_index(size_t index) const;
+
+			// Buckets holding entities
+			size_t bucket_count() const;
+
+			// Entities in the bucket, `bucket_capacity()` for all but the last one
+			size_t bucket_entity_count(size_t bucketIndex) const;
+
+			const config::mask_type& component_mask() const;
 
 			template<size_t _Index>
 			size_t component_offset() const;
@@ -174,16 +280,73 @@ namespace ecs
 			template<typename _T>
 			_T* get_component(entity_target entity) const;
 
+			// Index of this archetype in its world, stored in the entity mapping instead of a pointer
+			uint16_t archetype_index() const;
+
+			void set_archetype_index(uint16_t index);
+
+			// Where the buckets are allocated from, must be set before the first entity is added
+			void set_memory_resource(memory_resource& resource);
+
+			// Current change tick of the world, used to stamp changes
+			void set_tick(uint32_t tick);
+
+			// True if the component's column in the bucket has been changed or added after `since`
+			bool changed_since(size_t bucketIndex, size_t component, uint32_t since) const;
+
+			// True if the component's column in the bucket has been added after `since`
+			bool added_since(size_t bucketIndex, size_t component, uint32_t since) const;
+
+			// Marks the columns of all components in `mask` as changed at the current tick
+			void mark_changed(size_t bucketIndex, const config::mask_type& mask);
+
 			uint32_t emplace(entity entity);
 
+			// reserves a slot at the end, components are left unconstructed, returns { index, bucket }
+			std::pair<uint32_t, bucket*> allocate(entity entity);
+
+			// reserves `count` slots at the end, which must all fit in the last bucket, components are left unconstructed, returns { first index, bucket }
+			std::pair<uint32_t, bucket*> allocate(const entity* entities, size_t count);
+
 			template<typename = std::enable_if_t<(sizeof...(_Components) > 0)>>
 			uint32_t emplace(entity entity, _Components&&... move);
 
 			// erases entity at given index, returns the entity that took its place
 			uint32_t erase(size_t index);
 
-			//void reserve(size_t size);
-			const std::vector<std::unique_ptr<bucket>>& get_buckets() const;
+			// erases the entities at the given ascending and unique indices, calls `moved(id, index)` for every entity that took the place of another.
+			// Holes are filled from the tail in a single pass, consecutive holes and survivors are moved as one range, emptied buckets are released whole
+			template<typename _Moved>
+			void erase(const uint32_t* indices, size_t count, _Moved&& moved);
+
+			// allocates the memory for `size` entities in total, it's kept even when the archetype shrinks below it
+			void reserve(size_t size);
+
+			// allocates the memory for `size` entities in total, like `reserve` but in separate slabs that are freed again once the archetype shrinks
+			void grow_to(size_t size);
+
+			// Erased entities leave a dead slot behind instead of having the last entity moved into it,
+			// keeping the order and index of all other entities. Must not be disabled while there are dead slots.
+			void set_stable_erase(bool enable);
+
+			bool stable_erase() const;
+
+			// Dead slots below `size()`
+			size_t tombstone_count() const;
+
+			// Dead slot bits of the bucket, nullptr if it has none
+			const uint64_t* tombstones(size_t bucketIndex) const;
+
+			bool is_tombstone(size_t index) const;
+
+			static bool is_tombstone(const uint64_t* tombstones, size_t elementIndex);
+
+			// Repacks the live entities over the dead slots, visiting at most `budget` slots, the order of the entities is kept.
+			// Calls `moved(id, index)` for every entity that moved, returns the amount of slots visited. Continues where the last call left off
+			template<typename _Moved>
+			size_t compact(size_t budget, _Moved&& moved);
+
+			const std::vector<bucket*>& get_buckets() const;
 
 			constexpr explicit operator archetype_storage<>& ()
 			{
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 #include <utility>
+#include <memory>
 
 #include "../config.h"
 
@@ -9,327 +12,517 @@
 
 namespace ecs::details
 {
-	template<typename... _Components>
-	constexpr auto archetype_storage<_Components...>::bucket::components() -> ComponentData&
+	inline void entity_target::set(archetype_storage<>* archetype, uint32_t index)
 	{
-		return _component_data;
+		this->_archetype = archetype->archetype_index();
+		this->_index = index;
 	}
 
-	template<typename... _Components>
-	constexpr auto archetype_storage<_Components...>::bucket::components() const -> const ComponentData&
+	inline void entity_target::move(uint32_t index, archetype_storage<>& storage)
 	{
-		return _component_data;
+		this->_index = index;
+		this->_archetype = storage.archetype_index();
 	}
 
 	template<typename... _Components>
-	constexpr const entity& archetype_storage<_Components...>::bucket::get_entity(size_t index) const
+	constexpr entity* archetype_storage<_Components...>::bucket::entities()
 	{
-		assert(index < config::bucket_size);
-		return _to_entity[index];
+		return reinterpret_cast<entity*>(this);
 	}
 
 	template<typename... _Components>
-	constexpr size_t archetype_storage<_Components...>::bucket::size()
+	constexpr const entity& archetype_storage<_Components...>::bucket::get_entity(size_t index) const
 	{
-		return max_size;
+		assert(index < config::bucket_size);
+		return reinterpret_cast<const entity*>(this)[index];
 	}
 
 	template<typename... _Components>
 	template<typename _T>
-	constexpr component_row<_T>& archetype_storage<_Components...>::bucket::get()
+	constexpr component_row<_T>& archetype_storage<_Components...>::bucket::get_unsafe(size_t offset)
 	{
-		return static_cast<component_row<_T>&>(_component_data);
+		return *reinterpret_cast<component_row<_T>*>(uintptr_t(this) + offset);
 	}
 
 	template<typename... _Components>
 	template<typename _T>
-	constexpr const component_row<_T>& archetype_storage<_Components...>::bucket::get() const
+	constexpr _T& archetype_storage<_Components...>::bucket::get_unsafe(size_t offset, size_t index)
 	{
-		return static_cast<const component_row<_T>&>(_component_data);
+		return get_unsafe<_T>(offset)[index];
 	}
 
 	template<typename... _Components>
-	template<typename _T>
-	constexpr _T& archetype_storage<_Components...>::bucket::get(size_t index)
+	archetype_storage<_Components...>::archetype_storage()
 	{
-		return static_cast<component_row<_T>&>(_component_data)[index];
+		std::fill(_component_offsets, _component_offsets + std::size(_component_offsets), ~0);
 	}
 
 	template<typename... _Components>
-	template<typename _T>
-	constexpr component_row<_T>& archetype_storage<_Components...>::bucket::get_unsafe(size_t offset)
+	inline auto archetype_storage<_Components...>::get_buckets() const -> const std::vector<bucket*>&
 	{
-		return *reinterpret_cast<component_row<_T>*>(uintptr_t(&_component_data) + offset);
+		return _buckets;
 	}
 
 	template<typename... _Components>
-	template<typename _T>
-	constexpr _T& archetype_storage<_Components...>::bucket::get_unsafe(size_t offset, size_t index)
+	template<typename... _Cs>
+	inline void archetype_storage<_Components...>::initialize()
 	{
-		return get_unsafe<_T>(offset)[index];
+		// same layout as archetypes created at runtime, either may be looked up through the other
+		runtime_initialize(config::registry::template bit_mask_of<_Cs...>);
 	}
 
 	template<typename... _Components>
-	void* archetype_storage<_Components...>::bucket::operator new(size_t count)
+	inline void archetype_storage<_Components...>::initialize_columns()
 	{
-#if _WIN32
-		return _aligned_malloc(count, config::bucket_size);
-#else
-		return aligned_alloc(config::bucket_size, count);
-#endif
+		_pool.initialize(_bucket_size, _bucket_alignment);
+
+		_columns.clear();
+		_ticks.clear();
+
+		// relocatable columns first, these are a plain list of memcpy's, then the ones that need their relocate function.
+		// Tags only need their ticks and are skipped by the copy loops
+		enum column_kind { relocatable, non_relocatable, tag };
+		for (column_kind kind : { relocatable, non_relocatable, tag })
+		{
+			for (size_t i = 0; i < config::registry::count; ++i)
+			{
+				if (!_component_mask.test(i))
+					continue;
+
+				const size_t size = config::registry::_component_size[i];
+				const column_kind column = size == 0 ? tag : config::registry::_component_relocatable[i] ? relocatable : non_relocatable;
+
+				if (column == kind)
+				{
+					_component_columns[i] = uint16_t(_columns.size());
+
+					const uint32_t offset = uint32_t(component_offset(i));
+					_columns.push_back({ offset, offset, uint16_t(size), uint16_t(i), config::registry::_component_relocatable[i] });
+				}
+			}
+
+			if (kind == relocatable)
+				_relocatable_columns = _columns.size();
+			else if (kind == non_relocatable)
+				_storage_columns = _columns.size();
+		}
 	}
 
 	template<typename... _Components>
-	void archetype_storage<_Components...>::bucket::operator delete(void* ptr)
+	inline auto archetype_storage<_Components...>::allocate_bucket() -> bucket*
 	{
-#if _WIN32
-		_aligned_free(ptr);
-#else
-		free(ptr);
-#endif
+		// components are constructed per element when entities are placed, don't construct the whole bucket
+		auto* memory = static_cast<bucket*>(_pool.allocate());
+		std::uninitialized_default_construct_n(memory->entities(), _bucket_capacity);
+		return _buckets.emplace_back(memory);
 	}
 
 	template<typename... _Components>
-	template<size_t _Index>
-	constexpr component_row<std::tuple_element_t<_Index, std::tuple<_Components...>>>& archetype_storage<_Components...>::bucket::get()
+	inline void archetype_storage<_Components...>::shrink_buckets()
 	{
-		using Type = std::tuple_element_t<_Index, std::tuple<_Components...>>;
-		return static_cast<const component_row<Type>&>(_component_data);
+		const size_t used = bucket_count();
+		if (_buckets.size() > used)
+		{
+			_buckets.pop_back();
+			_pool.release();
+
+			// hysteresis, an archetype hovering around a slab boundary (or empty) doesn't free and allocate it over and over
+			_pool.shrink(std::max(used * 2 + 1, _reserved_buckets));
+		}
 	}
 
+#pragma region runtime functions
+
 	template<typename... _Components>
-	template<size_t _Index>
-	constexpr const component_row<std::tuple_element_t<_Index, std::tuple<_Components...>>>& archetype_storage<_Components...>::bucket::get() const
+	inline void archetype_storage<_Components...>::runtime_initialize(const config::mask_type& mask)
 	{
-		using Type = std::tuple_element_t<_Index, std::tuple<_Components...>>;
-		return static_cast<const component_row<Type>&>(_component_data);
+		_component_mask = mask;
+
+		// the entity ids form the first column
+		size_t entityBytes = sizeof(entity);
+		for (size_t i = 0; i < config::registry::count; ++i)
+		{
+			if (mask.test(i))
+				entityBytes += config::registry::_component_size[i];
+		}
+
+		// as many entities as fit the byte budget, rounded down to a power of 2 to keep the index math to shifts
+		size_t capacity = std::max<size_t>(config::bucket_bytes / entityBytes, 1);
+		while (capacity & (capacity - 1))
+			capacity &= capacity - 1;
+
+		capacity = std::clamp<size_t>(capacity, min_bucket_capacity, config::bucket_size);
+
+		// padding may push it over the budget
+		while (capacity > min_bucket_capacity && initialize_layout(capacity) > config::bucket_bytes)
+			capacity >>= 1;
+
+		_bucket_capacity = uint32_t(capacity);
+		_bucket_shift = 0;
+		while ((size_t(1) << _bucket_shift) < capacity)
+			++_bucket_shift;
+
+		_bucket_size = initialize_layout(capacity);
+
+		initialize_columns();
 	}
 
 	template<typename... _Components>
-	archetype_storage<_Components...>::archetype_storage()
-		: _bucket_size(sizeof(bucket))
+	inline size_t archetype_storage<_Components...>::initialize_layout(size_t capacity)
 	{
-		std::fill(_component_offsets, _component_offsets + std::size(_component_offsets), ~0);
+		size_t offset = sizeof(entity) * capacity;
+		_bucket_alignment = config::bucket_alignment;
 
-#if !ECS_ONLY_USE_RUNTIME_REMOVE_FUNC
-		if constexpr (sizeof...(_Components) > 0)
-			_removeOperation = &archetype_storage::remove;
-		else
-			_removeOperation = &archetype_storage::runtime_remove;
-#endif
+		// registry order, every archetype with the same mask has the same layout no matter how it's created
+		for (size_t i = 0; i < config::registry::count; ++i)
+		{
+			if (!_component_mask.test(i))
+				continue;
+
+			const size_t size = config::registry::_component_size[i];
+			const size_t alignment = std::max<size_t>(config::registry::_component_alignment[i], config::bucket_alignment);
+
+			// tags have no column
+			if (size != 0)
+			{
+				offset = (offset + alignment - 1) & ~(alignment - 1);
+				_bucket_alignment = std::max(_bucket_alignment, alignment);
+			}
+
+			assert(offset < std::numeric_limits<uint32_t>::max());
+			_component_offsets[i] = uint32_t(offset);
+
+			offset += size * capacity;
+		}
+
+		return offset;
 	}
 
 	template<typename... _Components>
-	inline auto archetype_storage<_Components...>::get_buckets() const -> const std::vector<std::unique_ptr<bucket>>&
+	inline auto archetype_storage<_Components...>::find_edge(size_t component, bool add) const -> const archetype_edge*
 	{
-		return _buckets;
+		const auto& edges = add ? _add_edges : _remove_edges;
+		for (auto& edge : edges)
+		{
+			if (edge._component == component)
+				return &edge;
+		}
+
+		return nullptr;
 	}
 
 	template<typename... _Components>
-	template<typename _T>
-	inline void archetype_storage<_Components...>::destruct(_T& object)
+	inline auto archetype_storage<_Components...>::emplace_edge(size_t component, bool add, archetype_storage<>& target) -> const archetype_edge&
 	{
-		object.~_T();
+		auto& edges = add ? _add_edges : _remove_edges;
+		return edges.emplace_back(make_edge(component, target));
 	}
 
 	template<typename... _Components>
-	template<typename _T>
-	inline void archetype_storage<_Components...>::move_and_destruct(_T& to, _T&& from)
+	inline auto archetype_storage<_Components...>::make_edge(size_t component, archetype_storage<>& target) const -> archetype_edge
 	{
-		to = std::move(from);
-		from.~_T();
+		archetype_edge edge{ component, &target, {}, 0, {} };
+
+		// `_columns` has the relocatable columns first, and so do the copies
+		for (size_t c = 0; c < _storage_columns; ++c)
+		{
+			auto& column = _columns[c];
+
+			if (target.component_mask().test(column._component))
+			{
+				auto copy = column;
+				copy._to_offset = uint32_t(target.component_offset(column._component));
+				edge._copies.push_back(copy);
+
+				if (column._relocatable)
+					++edge._relocatable_copies;
+			}
+			else if (!column._relocatable)
+				edge._drops.push_back(column);
+		}
+
+		return edge;
 	}
 
 	template<typename... _Components>
-	template<typename... _Cs, typename _MoveFunc, typename _RemoveFunc>
-	inline uint32_t archetype_storage<_Components...>::remove_internal(size_t index, _MoveFunc move_func, _RemoveFunc remove_func)
+	inline auto archetype_storage<_Components...>::move(size_t index, const archetype_edge& edge)
+		-> std::tuple<uint32_t, bucket*, uint32_t>
 	{
-		assert(index < _entity_count);
+		auto& target = *edge._target;
 
-		size_t entityCount = --_entity_count;
-		if (entityCount > 0)
-		{
-			size_t toIndex = index % config::bucket_size;
-			auto& to = _buckets[index / config::bucket_size];
+		size_t newIndex = target._entity_count++;
+		size_t newBucketIndex = target.bucket_index(newIndex);
+		size_t newElementIndex = target.element_index(newIndex);
 
-			size_t fromIndex = entityCount % config::bucket_size;
-			size_t fromBucketIndex = entityCount / config::bucket_size;
-			auto& from = _buckets[fromBucketIndex];
+		bucket* newBucket = newBucketIndex < target._buckets.size()
+			? target._buckets[newBucketIndex]
+			: target.allocate_bucket();
 
-			entity replaced = to->_to_entity[toIndex] = from->_to_entity[fromIndex];
-			from->_to_entity[fromIndex].invalidate();
+		size_t elementIndex = element_index(index);
+		auto& from = _buckets[bucket_index(index)];
 
-			size_t reverse = 0;
-			if constexpr (sizeof...(_Components) > 0)
-				((move_func(to->get<_Cs>(toIndex), std::move(from->get<_Cs>(fromIndex)), _component_mask), reverse) = ... = 0);
-			else
-			{
-				(([&]()
-				{
-					const size_t offset = component_offset<config::registry::template index_of<_Cs>>();
-					move_func(to->get_unsafe<_Cs>(offset, toIndex), std::move(from->get_unsafe<_Cs>(offset, fromIndex)), _component_mask);
-				}, reverse) = ... = 0);
-			}
+		newBucket->entities()[newElementIndex] = from->entities()[elementIndex];
 
-			if (fromIndex == 0)
-				_buckets.pop_back();
+		relocate_rows(edge, newBucket, newElementIndex, from, elementIndex, 1);
+		carry_ticks(edge, newBucketIndex, newElementIndex, bucket_index(index));
 
-			return replaced.get_id();
-		}
-		else
+		return { uint32_t(newIndex), newBucket, release_slot(index) };
+	}
+
+	template<typename... _Components>
+	template<typename _Placed>
+	inline void archetype_storage<_Components...>::move_all(const archetype_edge& edge, _Placed&& placed)
+	{
+		auto& target = *edge._target;
+
+		for (size_t b = 0, bucketCount = bucket_count(); b < bucketCount; ++b)
 		{
-			assert(_buckets.size() == 1);
+			bucket* from = _buckets[b];
+			const size_t count = bucket_entity_count(b);
+			const uint64_t* dead = tombstones(b);
 
-			size_t reverse = 0;
-			if constexpr (sizeof...(_Components) > 0)
-				((remove_func(_buckets[0]->get<_Cs>(0), _component_mask), reverse) = ... = 0);
-			else
+			// the source bucket may straddle two target buckets, dead slots are left behind
+			for (size_t fromIndex = 0; fromIndex < count; )
 			{
-				(([&]()
+				if (is_tombstone(dead, fromIndex))
 				{
-					const size_t offset = component_offset<config::registry::template index_of<_Cs>>();
-					remove_func(_buckets[0]->get_unsafe<_Cs>(offset, 0), _component_mask);
-				}, reverse) = ... = 0);
-			}
+					++fromIndex;
+					continue;
+				}
+
+				const size_t newIndex = target._entity_count;
+				const size_t newBucketIndex = target.bucket_index(newIndex), newElementIndex = target.element_index(newIndex);
+				const size_t maxRun = std::min(count - fromIndex, target._bucket_capacity - newElementIndex);
+
+				size_t run = 1;
+				while (run < maxRun && !is_tombstone(dead, fromIndex + run))
+					++run;
+
+				bucket* to = newBucketIndex < target._buckets.size()
+					? target._buckets[newBucketIndex]
+					: target.allocate_bucket();
+
+				target._entity_count += run;
+
+				std::copy(from->entities() + fromIndex, from->entities() + fromIndex + run, to->entities() + newElementIndex);
+				relocate_rows(edge, to, newElementIndex, from, fromIndex, run);
+				carry_ticks(edge, newBucketIndex, newElementIndex, b);
 
-			_buckets.clear();
+				placed(to, uint32_t(newIndex), run);
+				fromIndex += run;
+			}
 
-			return entity::npos;
+			for (size_t i = 0; i < count; ++i)
+				from->entities()[i].invalidate();
 		}
+
+		_entity_count = 0;
+
+		_tombstones.clear();
+		_bucket_tombstones.clear();
+		_tombstone_count = _compact_write = _compact_read = 0;
+
+		while (!_buckets.empty())
+			shrink_buckets();
 	}
 
 	template<typename... _Components>
-	inline uint32_t archetype_storage<_Components...>::remove(size_t index)
+	inline uint32_t archetype_storage<_Components...>::fill_hole(size_t index)
 	{
-		return remove_internal<_Components...>(index,
-			[](auto& to, auto&& from, auto mask) { move_and_destruct(to, std::move(from)); },
-			[](auto& remove, auto mask) { destruct(remove); });
+		assert(index < _entity_count);
+
+		size_t last = --_entity_count;
+		size_t fromIndex = element_index(last);
+		auto& from = _buckets[bucket_index(last)];
+
+		uint32_t replaced = entity::npos;
+		if (index != last)
+		{
+			size_t toIndex = element_index(index);
+			auto& to = _buckets[bucket_index(index)];
+
+			relocate_rows(to, toIndex, from, fromIndex, 1);
+
+			replaced = (to->entities()[toIndex] = from->entities()[fromIndex]).get_id();
+			merge_ticks(bucket_index(index), bucket_index(last));
+		}
+
+		from->entities()[fromIndex].invalidate();
+
+		if (fromIndex == 0)
+			shrink_buckets();
+
+		return replaced;
 	}
 
 	template<typename... _Components>
-	template<typename _T, typename _ComponentMatrix>
-	void archetype_storage<_Components...>::initialize_component_offset()
+	inline uint32_t archetype_storage<_Components...>::release_slot(size_t index)
 	{
-		typedef component_row<_T> Row;
-		constexpr size_t offset = offsetof(_ComponentMatrix, Row::_elements) / config::bucket_size;
-		static_assert(offset < std::numeric_limits<uint16_t>::max(), "Component offset can no longer fit in uint16_t storage, consider upgrading to uint32_t.");
-		_component_offsets[config::registry::template index_of<_T>] = uint16_t(offset);
+		if (!_stable_erase)
+			return fill_hole(index);
+
+		bury(index);
+		return entity::npos;
 	}
 
 	template<typename... _Components>
-	template<typename... _Cs>
-	inline void archetype_storage<_Components...>::initialize()
+	inline void archetype_storage<_Components...>::bury(size_t index)
 	{
-		typedef component_matrix<_Cs...> ComponentMatrix;
-		_component_mask = config::registry::template bit_mask_of<_Cs...>;
-		_bucket_size = sizeof(archetype_storage<_Cs...>::bucket);
+		assert(index < _entity_count && !is_tombstone(index));
 
-		(initialize_component_offset<_Cs, ComponentMatrix>(), ...);
+		_buckets[bucket_index(index)]->entities()[element_index(index)].invalidate();
+
+		if (index + 1 < _entity_count)
+		{
+			set_tombstone(index);
+			return;
+		}
+
+		// nothing to mark at the end, drop the slot along with the dead ones before it
+		--_entity_count;
+		while (_entity_count > 0 && is_tombstone(_entity_count - 1))
+			clear_tombstone(--_entity_count);
+
+		_compact_read = std::min(_compact_read, _entity_count);
+		_compact_write = std::min(_compact_write, _compact_read);
+
+		while (_buckets.size() > bucket_count())
+			shrink_buckets();
 	}
 
-#pragma region runtime functions
+	template<typename... _Components>
+	inline size_t archetype_storage<_Components...>::tombstone_words() const
+	{
+		return (_bucket_capacity + 63) >> 6;
+	}
 
 	template<typename... _Components>
-	template<typename... _Cs>
-	inline void archetype_storage<_Components...>::runtime_initialize(size_t mask, ecs::pack<_Cs...>)
+	inline void archetype_storage<_Components...>::set_tombstone(size_t index)
 	{
-		using offset_t = std::remove_reference_t<decltype(*_component_offsets)>;
+		const size_t bucketIndex = bucket_index(index), element = element_index(index);
 
-		size_t bucketSize = 0;
+		if (_bucket_tombstones.size() <= bucketIndex)
+		{
+			_bucket_tombstones.resize(bucketIndex + 1, 0);
+			_tombstones.resize((bucketIndex + 1) * tombstone_words(), 0);
+		}
 
-		([&]()
-			{
-				constexpr size_t i = config::registry::template index_of<_Cs>;
-				constexpr size_t componentMask = 1ull << i;
+		_tombstones[bucketIndex * tombstone_words() + (element >> 6)] |= uint64_t(1) << (element & 63);
+		++_bucket_tombstones[bucketIndex];
+		++_tombstone_count;
+	}
 
-				if (componentMask & mask)
-				{
-					assert(bucketSize < std::numeric_limits<offset_t>::max());
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::clear_tombstone(size_t index)
+	{
+		const size_t bucketIndex = bucket_index(index), element = element_index(index);
 
-					// size storing as: sizeof(T[config::bucket_size]) / config::bucket_size = sizeof(T)
-					_component_offsets[i] = offset_t(bucketSize);
+		_tombstones[bucketIndex * tombstone_words() + (element >> 6)] &= ~(uint64_t(1) << (element & 63));
+		--_bucket_tombstones[bucketIndex];
+		--_tombstone_count;
+	}
 
-					bucketSize += offset_t(ecs::config::registry::_component_size[i]);
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::relocate_rows(bucket* to, size_t toIndex, bucket* from, size_t fromIndex, size_t count)
+	{
+		const uintptr_t fromData = uintptr_t(from);
+		const uintptr_t toData = uintptr_t(to);
 
-				}
-			}(), ...);
+		// rows of a column are contiguous, the whole range is a single copy
+		for (size_t c = 0; c < _relocatable_columns; ++c)
+		{
+			auto& column = _columns[c];
+			std::memcpy(reinterpret_cast<void*>(toData + column._to_offset + toIndex * column._size),
+				reinterpret_cast<void*>(fromData + column._from_offset + fromIndex * column._size), count * column._size);
+		}
 
-		_component_mask = mask;
-		_bucket_size = bucketSize * config::bucket_size + sizeof(archetype_storage<>::bucket);
+		for (size_t c = _relocatable_columns; c < _storage_columns; ++c)
+		{
+			auto& column = _columns[c];
+			auto relocate = config::registry::_component_relocate[column._component];
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				relocate(reinterpret_cast<void*>(toData + column._to_offset + (toIndex + i) * column._size),
+					reinterpret_cast<void*>(fromData + column._from_offset + (fromIndex + i) * column._size));
+			}
+		}
 	}
 
 	template<typename... _Components>
-	template<typename... _Cs>
-	inline auto archetype_storage<_Components...>::runtime_move(size_t index, archetype_storage<>& new_storage, ecs::pack<_Cs...>)
-		-> std::tuple<uint32_t, bucket*, uint32_t>
+	inline void archetype_storage<_Components...>::relocate_rows(const archetype_edge& edge, bucket* to, size_t toIndex, bucket* from, size_t fromIndex, size_t count)
 	{
-		size_t newIndex = new_storage._entity_count++;
-		size_t newBucketIndex = newIndex / config::bucket_size;
-		size_t newElementIndex = newIndex % config::bucket_size;
-
-		auto& newBucket = newBucketIndex < new_storage._buckets.size()
-			? new_storage._buckets[newBucketIndex]
-			: new_storage._buckets.emplace_back(new (new_storage._bucket_size) bucket());
+		const uintptr_t fromData = uintptr_t(from);
+		const uintptr_t toData = uintptr_t(to);
 
-		size_t toIndex = index % config::bucket_size;
-		auto& to = _buckets[index / config::bucket_size];
+		const column_copy* column = edge._copies.data();
+		for (const column_copy* end = column + edge._relocatable_copies; column != end; ++column)
+		{
+			std::memcpy(reinterpret_cast<void*>(toData + column->_to_offset + toIndex * column->_size),
+				reinterpret_cast<void*>(fromData + column->_from_offset + fromIndex * column->_size), count * column->_size);
+		}
 
-		newBucket->_to_entity[newElementIndex] = to->_to_entity[toIndex];
+		for (const column_copy* end = edge._copies.data() + edge._copies.size(); column != end; ++column)
+		{
+			auto relocate = config::registry::_component_relocate[column->_component];
 
-		return { uint32_t(newIndex), newBucket.get(), remove_internal<_Cs...>(index,
-			[&](auto& to, auto&& from, auto mask)
+			for (size_t i = 0; i < count; ++i)
 			{
-				typedef std::remove_reference_t<decltype(to)> _Cs;
-				
-				if (config::registry::template bit_mask_of<_Cs> & mask)
-				{
-					const size_t newOffset = new_storage.component_offset<config::registry::template index_of<_Cs>>();
-
-					newBucket->get_unsafe<_Cs>(newOffset, newElementIndex) = std::move(to);
-					move_and_destruct(to, std::move(from));
-				}
-			},
-			[&](auto& remove, auto mask)
-			{
-				typedef std::remove_reference_t<decltype(remove)> _Cs;
+				relocate(reinterpret_cast<void*>(toData + column->_to_offset + (toIndex + i) * column->_size),
+					reinterpret_cast<void*>(fromData + column->_from_offset + (fromIndex + i) * column->_size));
+			}
+		}
 
-				if (config::registry::template bit_mask_of<_Cs> & mask)
-				{
-					const size_t newOffset = new_storage.component_offset<config::registry::template index_of<_Cs>>();
+		for (auto& drop : edge._drops)
+		{
+			auto destruct = config::registry::_component_destruct[drop._component];
 
-					move_and_destruct(newBucket->get_unsafe<_Cs>(newOffset, newElementIndex), std::move(remove));
-				}
-			}) };
+			for (size_t i = 0; i < count; ++i)
+				destruct(reinterpret_cast<void*>(fromData + drop._from_offset + (fromIndex + i) * drop._size));
+		}
 	}
 
 	template<typename... _Components>
-	template<typename... _Cs>
-	inline uint32_t archetype_storage<_Components...>::runtime_remove_internal(size_t index, ecs::pack<_Cs...>)
+	inline void archetype_storage<_Components...>::carry_ticks(const archetype_edge& edge, size_t toBucketIndex, size_t toElementIndex, size_t fromBucketIndex) const
 	{
-		return remove_internal<_Cs...>(index,
-			[](auto& to, auto&& from, auto mask)
-			{
-				typedef std::remove_reference_t<decltype(to)> _Cs;
+		auto& target = *edge._target;
 
-				if (config::registry::template bit_mask_of<_Cs> & mask)
-					move_and_destruct(to, std::move(from));
-			},
-			[](auto& remove, auto mask)
-			{
-				typedef std::remove_reference_t<decltype(remove)> _Cs;
+		// common columns keep their ticks, the added column is new
+		uint32_t* toTicks = target.allocate_ticks(toBucketIndex);
+		const uint32_t* fromTicks = bucket_ticks(fromBucketIndex);
+		const size_t toColumns = target._columns.size(), fromColumns = _columns.size();
 
-				if constexpr (!std::is_trivially_destructible_v<_Cs>)
-				{
-					if (config::registry::template bit_mask_of<_Cs> & mask)
-						remove.~_Cs();
-				}
-			});
+		if (toElementIndex == 0)
+			std::fill(toTicks, toTicks + toColumns * 2, 0);
+
+		for (size_t c = 0; c < toColumns; ++c)
+		{
+			const size_t component = target._columns[c]._component;
+			if (_component_mask.test(component))
+			{
+				const size_t fromColumn = _component_columns[component];
+				toTicks[c] = std::max(toTicks[c], fromTicks[fromColumn]);
+				toTicks[toColumns + c] = std::max(toTicks[toColumns + c], fromTicks[fromColumns + fromColumn]);
+			}
+			else
+				toTicks[c] = toTicks[toColumns + c] = target._tick;
+		}
 	}
 
 	template<typename... _Components>
-	inline uint32_t archetype_storage<_Components...>::runtime_remove(size_t index)
+	inline void archetype_storage<_Components...>::destruct_rows(bucket* _bucket, size_t index, size_t count)
 	{
-		return runtime_remove_internal(index, ecs::config::registry::components());
+		const uintptr_t data = uintptr_t(_bucket);
+
+		// relocatable columns are trivially destructible
+		for (size_t c = _relocatable_columns; c < _storage_columns; ++c)
+		{
+			auto& column = _columns[c];
+			auto destruct = config::registry::_component_destruct[column._component];
+
+			for (size_t i = 0; i < count; ++i)
+				destruct(reinterpret_cast<void*>(data + column._from_offset + (index + i) * column._size));
+		}
 	}
 
 	template<typename... _Components>
@@ -337,27 +530,27 @@ namespace ecs::details
 	inline uint32_t archetype_storage<_Components...>::runtime_emplace(entity entity, ecs::pack<_Cs...>)
 	{
 		size_t size = _entity_count++;
-		size_t index = size % config::bucket_size, bucketIndex = size / config::bucket_size;
+		size_t index = element_index(size), bucketIndex = bucket_index(size);
 
-		auto& _bucket = bucketIndex < _buckets.size()
+		bucket* _bucket = bucketIndex < _buckets.size()
 			? _buckets[bucketIndex]
-			: _buckets.emplace_back((bucket*)new uint8_t[this->_bucket_size]);
+			: allocate_bucket();
 
-		_bucket->_to_entity[index] = entity;
+		_bucket->entities()[index] = entity;
+		stamp_added(bucketIndex);
 
 		([&]()
 			{
-				//if constexpr (!std::is_trivially_constructible_v<_Cs>)
+				if constexpr (!is_tag_v<_Cs>)
 				{
-					constexpr size_t i = config::registry::template index_of<_Cs>();
-					constexpr size_t mask = 1ull << i;
+					constexpr size_t i = config::registry::template index_of<_Cs>;
 
-					if (mask & _component_mask)
-						new (&_bucket->get_unsafe<_Cs>(_component_offsets[i], index)) _Cs();
+					if (_component_mask.test(i))
+						new (&_bucket->template get_unsafe<_Cs>(component_offset(i), index)) _Cs();
 				}
 			}(), ...);
 
-		return uint32_t(bucketIndex * config::bucket_size + index);
+		return uint32_t(size);
 	}
 
 #pragma endregion
@@ -369,7 +562,43 @@ namespace ecs::details
 	}
 
 	template<typename... _Components>
-	inline size_t archetype_storage<_Components...>::component_mask() const
+	inline size_t archetype_storage<_Components...>::live_size() const
+	{
+		return _entity_count - _tombstone_count;
+	}
+
+	template<typename... _Components>
+	inline size_t archetype_storage<_Components...>::bucket_capacity() const
+	{
+		return _bucket_capacity;
+	}
+
+	template<typename... _Components>
+	inline size_t archetype_storage<_Components...>::bucket_index(size_t index) const
+	{
+		return index >> _bucket_shift;
+	}
+
+	template<typename... _Components>
+	inline size_t archetype_storage<_Components...>::element_index(size_t index) const
+	{
+		return index & (_bucket_capacity - 1);
+	}
+
+	template<typename... _Components>
+	inline size_t archetype_storage<_Components...>::bucket_count() const
+	{
+		return (_entity_count + _bucket_capacity - 1) >> _bucket_shift;
+	}
+
+	template<typename... _Components>
+	inline size_t archetype_storage<_Components...>::bucket_entity_count(size_t bucketIndex) const
+	{
+		return std::min(_entity_count - (bucketIndex << _bucket_shift), size_t(_bucket_capacity));
+	}
+
+	template<typename... _Components>
+	inline auto archetype_storage<_Components...>::component_mask() const -> const config::mask_type&
 	{
 		return _component_mask;
 	}
@@ -378,13 +607,13 @@ namespace ecs::details
 	template<size_t _Index>
 	inline size_t archetype_storage<_Components...>::component_offset() const
 	{
-		return _component_offsets[_Index] * config::bucket_size;
+		return _component_offsets[_Index];
 	}
 
 	template<typename... _Components>
 	inline size_t archetype_storage<_Components...>::component_offset(size_t index) const
 	{
-		return _component_offsets[index] * config::bucket_size;
+		return _component_offsets[index];
 	}
 
 	template<typename... _Components>
@@ -392,38 +621,152 @@ namespace ecs::details
 	inline _T* archetype_storage<_Components...>::get_component(entity_target entity) const
 	{
 		size_t offset = _component_offsets[config::registry::template index_of<_T>];
-		if (offset != std::numeric_limits<uint16_t>::max())
+		if constexpr (is_tag_v<_T>)
+			return offset != std::numeric_limits<uint32_t>::max() ? &component_row<_T>::_instance : nullptr;
+		else if (offset != std::numeric_limits<uint32_t>::max())
 		{
-			size_t index = entity._index % config::bucket_size, bucketIndex = entity._index / config::bucket_size;
-
-			auto& bucket = _buckets[bucketIndex];
-			const uintptr_t componentStart = uintptr_t(&bucket->components());
-
-			return reinterpret_cast<_T*>(componentStart + (offset * config::bucket_size)) + index;
+			return &_buckets[bucket_index(entity._index)]->template get_unsafe<_T>(offset, element_index(entity._index));
 		}
 
 		return nullptr;
 	}
 
+	template<typename... _Components>
+	inline uint32_t* archetype_storage<_Components...>::bucket_ticks(size_t bucketIndex)
+	{
+		return _ticks.data() + bucketIndex * _columns.size() * 2;
+	}
+
+	template<typename... _Components>
+	inline const uint32_t* archetype_storage<_Components...>::bucket_ticks(size_t bucketIndex) const
+	{
+		return _ticks.data() + bucketIndex * _columns.size() * 2;
+	}
+
+	template<typename... _Components>
+	inline uint32_t* archetype_storage<_Components...>::allocate_ticks(size_t bucketIndex)
+	{
+		const size_t size = (bucketIndex + 1) * _columns.size() * 2;
+		if (_ticks.size() < size)
+			_ticks.resize(size, 0);
+
+		return bucket_ticks(bucketIndex);
+	}
+
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::stamp_added(size_t bucketIndex)
+	{
+		uint32_t* ticks = allocate_ticks(bucketIndex);
+		std::fill(ticks, ticks + _columns.size() * 2, _tick);
+	}
+
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::merge_ticks(size_t toBucketIndex, size_t fromBucketIndex)
+	{
+		if (toBucketIndex == fromBucketIndex)
+			return;
+
+		uint32_t* to = bucket_ticks(toBucketIndex);
+		const uint32_t* from = bucket_ticks(fromBucketIndex);
+
+		for (size_t i = 0, size = _columns.size() * 2; i < size; ++i)
+			to[i] = std::max(to[i], from[i]);
+	}
+
+	template<typename... _Components>
+	inline uint16_t archetype_storage<_Components...>::archetype_index() const
+	{
+		return _archetype_index;
+	}
+
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::set_archetype_index(uint16_t index)
+	{
+		_archetype_index = index;
+	}
+
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::set_memory_resource(memory_resource& resource)
+	{
+		_pool.set_resource(resource);
+	}
+
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::set_tick(uint32_t tick)
+	{
+		_tick = tick;
+	}
+
+	template<typename... _Components>
+	inline bool archetype_storage<_Components...>::changed_since(size_t bucketIndex, size_t component, uint32_t since) const
+	{
+		return bucket_ticks(bucketIndex)[_component_columns[component]] > since;
+	}
+
+	template<typename... _Components>
+	inline bool archetype_storage<_Components...>::added_since(size_t bucketIndex, size_t component, uint32_t since) const
+	{
+		return bucket_ticks(bucketIndex)[_columns.size() + _component_columns[component]] > since;
+	}
+
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::mark_changed(size_t bucketIndex, const config::mask_type& mask)
+	{
+		uint32_t* ticks = bucket_ticks(bucketIndex);
+
+		for (size_t c = 0, size = _columns.size(); c < size; ++c)
+		{
+			if (mask.test(_columns[c]._component))
+				ticks[c] = _tick;
+		}
+	}
+
 	template<typename... _Components>
 	template<typename... _Cs>
 	inline uint32_t archetype_storage<_Components...>::emplace_internal(entity entity, _Cs&&... move)
 	{
 		size_t size = _entity_count++;
-		size_t index = size % config::bucket_size, bucketIndex = size / config::bucket_size;
+		size_t index = element_index(size), bucketIndex = bucket_index(size);
 
-		auto& _bucket = bucketIndex < _buckets.size()
+		bucket* _bucket = bucketIndex < _buckets.size()
 			? _buckets[bucketIndex]
-			: _buckets.emplace_back(std::make_unique<bucket>());
+			: allocate_bucket();
 
-		_bucket->_to_entity[index] = entity;
+		_bucket->entities()[index] = entity;
+		stamp_added(bucketIndex);
 
+		// buckets come unconstructed, tags have nothing to construct
 		if constexpr (sizeof...(_Cs) > 0)
-			((_bucket->get<_Cs>(index) = std::move(move)), ...);
+			([&]() { if constexpr (!is_tag_v<_Cs>) new (&_bucket->template get_unsafe<_Cs>(component_offset<config::registry::template index_of<_Cs>>(), index)) _Cs(std::move(move)); }(), ...);
 		else
-			((_bucket->get<_Cs>(index)._Cs()), ...);
+			([&]() { if constexpr (!is_tag_v<_Components>) new (&_bucket->template get_unsafe<_Components>(component_offset<config::registry::template index_of<_Components>>(), index)) _Components(); }(), ...);
+
+		return uint32_t(size);
+	}
 
-		return uint32_t(bucketIndex * config::bucket_size + index);
+	template<typename... _Components>
+	inline auto archetype_storage<_Components...>::allocate(entity entity) -> std::pair<uint32_t, bucket*>
+	{
+		return allocate(&entity, 1);
+	}
+
+	template<typename... _Components>
+	inline auto archetype_storage<_Components...>::allocate(const entity* entities, size_t count) -> std::pair<uint32_t, bucket*>
+	{
+		size_t size = _entity_count;
+		size_t index = element_index(size), bucketIndex = bucket_index(size);
+		assert(count > 0 && index + count <= _bucket_capacity);
+
+		_entity_count += count;
+
+		bucket* _bucket = bucketIndex < _buckets.size()
+			? _buckets[bucketIndex]
+			: allocate_bucket();
+
+		std::copy(entities, entities + count, _bucket->entities() + index);
+		stamp_added(bucketIndex);
+
+		return { uint32_t(size), _bucket };
 	}
 
 	template<typename... _Components>
@@ -442,22 +785,233 @@ namespace ecs::details
 	template<typename... _Components>
 	inline uint32_t archetype_storage<_Components...>::erase(size_t index)
 	{
-#if ECS_ONLY_USE_RUNTIME_REMOVE_FUNC
-		return runtime_remove(index);
-#else
-		return (this->*_removeOperation)(index);
-#endif
+		assert(index < _entity_count);
+
+		destruct_rows(_buckets[bucket_index(index)], element_index(index), 1);
+		return release_slot(index);
 	}
 
-	/*template<typename... _Components>
+	template<typename... _Components>
+	template<typename _Moved>
+	inline void archetype_storage<_Components...>::erase(const uint32_t* indices, size_t count, _Moved&& moved)
+	{
+		if (count == 0)
+			return;
+
+		assert(std::is_sorted(indices, indices + count) && std::adjacent_find(indices, indices + count) == indices + count && indices[count - 1] < _entity_count);
+
+		// destroy per run of victims within a bucket
+		for (size_t v = 0; v < count; )
+		{
+			size_t run = 1;
+			while (v + run < count && indices[v + run] == indices[v] + run && element_index(indices[v]) + run < _bucket_capacity)
+				++run;
+
+			destruct_rows(_buckets[bucket_index(indices[v])], element_index(indices[v]), run);
+			v += run;
+		}
+
+		// back to front, a dead tail is dropped at once
+		if (_stable_erase)
+		{
+			for (size_t v = count; v-- > 0; )
+				bury(indices[v]);
+
+			return;
+		}
+
+		const size_t size = _entity_count - count;
+
+		// every hole below the new size takes a survivor from above it, both ascending
+		const size_t holes = std::lower_bound(indices, indices + count, uint32_t(size)) - indices;
+		size_t victim = holes;
+		size_t from = size;
+
+		for (size_t hole = 0; hole < holes; )
+		{
+			while (victim < count && indices[victim] == from)
+			{
+				++victim;
+				++from;
+			}
+
+			const size_t to = indices[hole];
+			const size_t toIndex = element_index(to), fromIndex = element_index(from);
+
+			// grow the range while both sides stay consecutive and within their bucket
+			size_t run = 1;
+			while (hole + run < holes && indices[hole + run] == to + run
+				&& (victim == count || indices[victim] != from + run)
+				&& toIndex + run < _bucket_capacity && fromIndex + run < _bucket_capacity)
+				++run;
+
+			bucket* toBucket = _buckets[bucket_index(to)];
+			bucket* fromBucket = _buckets[bucket_index(from)];
+
+			relocate_rows(toBucket, toIndex, fromBucket, fromIndex, run);
+			std::copy(fromBucket->entities() + fromIndex, fromBucket->entities() + fromIndex + run, toBucket->entities() + toIndex);
+			merge_ticks(bucket_index(to), bucket_index(from));
+
+			for (size_t i = 0; i < run; ++i)
+				moved(toBucket->entities()[toIndex + i].get_id(), uint32_t(to + i));
+
+			hole += run;
+			from += run;
+		}
+
+		for (size_t i = size; i < _entity_count; ++i)
+			_buckets[bucket_index(i)]->entities()[element_index(i)].invalidate();
+
+		_entity_count = size;
+
+		while (_buckets.size() > bucket_count())
+			shrink_buckets();
+	}
+
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::set_stable_erase(bool enable)
+	{
+		assert(enable || _tombstone_count == 0);
+		_stable_erase = enable;
+	}
+
+	template<typename... _Components>
+	inline bool archetype_storage<_Components...>::stable_erase() const
+	{
+		return _stable_erase;
+	}
+
+	template<typename... _Components>
+	inline size_t archetype_storage<_Components...>::tombstone_count() const
+	{
+		return _tombstone_count;
+	}
+
+	template<typename... _Components>
+	inline const uint64_t* archetype_storage<_Components...>::tombstones(size_t bucketIndex) const
+	{
+		return bucketIndex < _bucket_tombstones.size() && _bucket_tombstones[bucketIndex] > 0
+			? _tombstones.data() + bucketIndex * tombstone_words()
+			: nullptr;
+	}
+
+	template<typename... _Components>
+	inline bool archetype_storage<_Components...>::is_tombstone(size_t index) const
+	{
+		return is_tombstone(tombstones(bucket_index(index)), element_index(index));
+	}
+
+	template<typename... _Components>
+	inline bool archetype_storage<_Components...>::is_tombstone(const uint64_t* tombstones, size_t elementIndex)
+	{
+		return tombstones && (tombstones[elementIndex >> 6] >> (elementIndex & 63) & 1);
+	}
+
+	template<typename... _Components>
+	template<typename _Moved>
+	inline size_t archetype_storage<_Components...>::compact(size_t budget, _Moved&& moved)
+	{
+		if (_tombstone_count == 0)
+			return 0;
+
+		// a new pass starts at the first dead slot
+		if (_compact_read == _compact_write)
+		{
+			size_t b = 0;
+			while (_bucket_tombstones[b] == 0)
+				++b;
+
+			size_t index = b << _bucket_shift;
+			while (!is_tombstone(index))
+				++index;
+
+			_compact_write = _compact_read = index;
+		}
+
+		size_t visited = 0;
+		while (visited < budget && _compact_read < _entity_count)
+		{
+			const size_t read = _compact_read, write = _compact_write;
+
+			// dead slots are skipped, live ones without a dead slot before them stay put
+			if (is_tombstone(read) || read == write)
+			{
+				if (read == write && !is_tombstone(read))
+					++_compact_write;
+
+				++_compact_read;
+				++visited;
+				continue;
+			}
+
+			const size_t readElement = element_index(read), writeElement = element_index(write);
+
+			// consecutive live entities move as a range, as long as it doesn't overlap the dead slots it moves into
+			size_t run = 1;
+			while (run < budget - visited && run < read - write && read + run < _entity_count && !is_tombstone(read + run)
+				&& readElement + run < _bucket_capacity && writeElement + run < _bucket_capacity)
+				++run;
+
+			bucket* from = _buckets[bucket_index(read)];
+			bucket* to = _buckets[bucket_index(write)];
+
+			relocate_rows(to, writeElement, from, readElement, run);
+			std::copy(from->entities() + readElement, from->entities() + readElement + run, to->entities() + writeElement);
+			merge_ticks(bucket_index(write), bucket_index(read));
+
+			for (size_t i = 0; i < run; ++i)
+			{
+				clear_tombstone(write + i);
+				set_tombstone(read + i);
+				from->entities()[readElement + i].invalidate();
+
+				moved(to->entities()[writeElement + i].get_id(), uint32_t(write + i));
+			}
+
+			_compact_write += run;
+			_compact_read += run;
+			visited += run;
+		}
+
+		// pass done, all slots from the write position on are dead
+		if (_compact_read >= _entity_count)
+		{
+			for (size_t index = _compact_write; index < _entity_count; ++index)
+			{
+				assert(is_tombstone(index));
+				clear_tombstone(index);
+			}
+
+			_entity_count = _compact_write;
+			_compact_write = _compact_read = 0;
+
+			while (_buckets.size() > bucket_count())
+				shrink_buckets();
+		}
+
+		return visited;
+	}
+
+	template<typename... _Components>
 	inline void archetype_storage<_Components...>::reserve(size_t size)
 	{
-		size_t index = size % config::bucket_size, bucketSize = size / config::bucket_size;
+		const size_t bucketCount = (size + _bucket_capacity - 1) >> _bucket_shift;
+
+		_buckets.reserve(bucketCount);
+		_pool.reserve(bucketCount);
 
-		buckets.reserve(bucketSize + 1);
+		_ticks.reserve(bucketCount * _columns.size() * 2);
+		_reserved_buckets = std::max(_reserved_buckets, bucketCount);
+	}
 
-		auto it = buckets.data(), end = it + (buckets.capacity() - buckets.size());
-		for (; it != end; ++it)
-			*it = new bucket();
-	}*/
+	template<typename... _Components>
+	inline void archetype_storage<_Components...>::grow_to(size_t size)
+	{
+		const size_t bucketCount = (size + _bucket_capacity - 1) >> _bucket_shift;
+
+		_buckets.reserve(bucketCount);
+		_pool.grow(bucketCount);
+
+		_ticks.reserve(bucketCount * _columns.size() * 2);
+	}
 }
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ECS_BIT_MASK_AVX2 true
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ECS_BIT_MASK_SSE2 true
+#endif
+
+namespace ecs::details
+{
+	// Width of the component masks, 64 bits or the next power of 2 that fits all components, e.g.: 128, 256 or 512
+	constexpr size_t bit_mask_width(size_t count)
+	{
+		size_t bits = 64;
+		while (bits < count)
+			bits *= 2;
+
+		return bits;
+	}
+
+	// Fixed width bit mask, stored as 64-bit words.
+	// A single word mask compiles down to plain integer operations, wider masks use SSE2/AVX2 for `masked_equals`.
+	template<size_t _Bits>
+	struct alignas(_Bits >= 256 ? 32 : _Bits / 8) bit_mask
+	{
+		static constexpr size_t word_count = _Bits / 64;
+		static_assert(_Bits % 64 == 0 && word_count > 0, "Bit mask width must be a multiple of 64.");
+
+		uint64_t _words[word_count]{};
+
+		static constexpr bit_mask bit(size_t index);
+
+		// (mask & filter) == value, branch-free over all words
+		static bool masked_equals(const bit_mask& mask, const bit_mask& filter, const bit_mask& value);
+
+		constexpr bool test(size_t index) const;
+
+		constexpr bit_mask& set(size_t index);
+
+		constexpr bit_mask& reset(size_t index);
+
+		constexpr bool any() const;
+
+		// amount of set bits
+		size_t count() const;
+
+		// index of the lowest set bit, `_Bits` if there's none
+		size_t first() const;
+
+		uint64_t hash() const;
+
+		constexpr bit_mask operator~() const;
+		constexpr bit_mask operator|(const bit_mask& other) const;
+		constexpr bit_mask operator&(const bit_mask& other) const;
+		constexpr bit_mask operator^(const bit_mask& other) const;
+
+		constexpr bit_mask& operator|=(const bit_mask& other);
+		constexpr bit_mask& operator&=(const bit_mask& other);
+
+		constexpr bool operator==(const bit_mask& other) const;
+		constexpr bool operator!=(const bit_mask& other) const;
+
+		// arbitrary but strict ordering, e.g.: to group by mask
+		constexpr bool operator<(const bit_mask& other) const;
+	};
+
+	template<size_t _Bits>
+	inline constexpr bit_mask<_Bits> bit_mask<_Bits>::bit(size_t index)
+	{
+		bit_mask mask;
+		mask._words[index / 64] = uint64_t(1) << (index % 64);
+		return mask;
+	}
+
+	template<size_t _Bits>
+	inline bool bit_mask<_Bits>::masked_equals(const bit_mask& mask, const bit_mask& filter, const bit_mask& value)
+	{
+#if ECS_BIT_MASK_AVX2
+		if constexpr (word_count % 4 == 0)
+		{
+			__m256i difference = _mm256_setzero_si256();
+			for (size_t i = 0; i < word_count; i += 4)
+			{
+				const __m256i masked = _mm256_and_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(mask._words + i)), _mm256_load_si256(reinterpret_cast<const __m256i*>(filter._words + i)));
+				difference = _mm256_or_si256(difference, _mm256_xor_si256(masked, _mm256_load_si256(reinterpret_cast<const __m256i*>(value._words + i))));
+			}
+
+			return _mm256_testz_si256(difference, difference) != 0;
+		}
+		else
+#endif
+#if ECS_BIT_MASK_SSE2
+		if constexpr (word_count % 2 == 0)
+		{
+			__m128i difference = _mm_setzero_si128();
+			for (size_t i = 0; i < word_count; i += 2)
+			{
+				const __m128i masked = _mm_and_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(mask._words + i)), _mm_load_si128(reinterpret_cast<const __m128i*>(filter._words + i)));
+				difference = _mm_or_si128(difference, _mm_xor_si128(masked, _mm_load_si128(reinterpret_cast<const __m128i*>(value._words + i))));
+			}
+
+			return _mm_movemask_epi8(_mm_cmpeq_epi8(difference, _mm_setzero_si128())) == 0xFFFF;
+		}
+		else
+#endif
+		{
+			uint64_t difference = 0;
+			for (size_t i = 0; i < word_count; ++i)
+				difference |= (mask._words[i] & filter._words[i]) ^ value._words[i];
+
+			return difference == 0;
+		}
+	}
+
+	template<size_t _Bits>
+	inline constexpr bool bit_mask<_Bits>::test(size_t index) const
+	{
+		return (_words[index / 64] >> (index % 64)) & 1;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bit_mask<_Bits>& bit_mask<_Bits>::set(size_t index)
+	{
+		_words[index / 64] |= uint64_t(1) << (index % 64);
+		return *this;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bit_mask<_Bits>& bit_mask<_Bits>::reset(size_t index)
+	{
+		_words[index / 64] &= ~(uint64_t(1) << (index % 64));
+		return *this;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bool bit_mask<_Bits>::any() const
+	{
+		uint64_t any = 0;
+		for (size_t i = 0; i < word_count; ++i)
+			any |= _words[i];
+
+		return any != 0;
+	}
+
+	template<size_t _Bits>
+	inline size_t bit_mask<_Bits>::count() const
+	{
+		size_t count = 0;
+		for (size_t i = 0; i < word_count; ++i)
+		{
+			for (uint64_t word = _words[i]; word; word &= word - 1)
+				++count;
+		}
+
+		return count;
+	}
+
+	template<size_t _Bits>
+	inline size_t bit_mask<_Bits>::first() const
+	{
+		for (size_t i = 0; i < word_count; ++i)
+		{
+			if (_words[i])
+			{
+				size_t index = i * 64;
+				for (uint64_t word = _words[i]; !(word & 1); word >>= 1)
+					++index;
+
+				return index;
+			}
+		}
+
+		return _Bits;
+	}
+
+	template<size_t _Bits>
+	inline uint64_t bit_mask<_Bits>::hash() const
+	{
+		uint64_t hash = _words[0];
+		for (size_t i = 1; i < word_count; ++i)
+			hash ^= _words[i] + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+
+		return hash;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bit_mask<_Bits> bit_mask<_Bits>::operator~() const
+	{
+		bit_mask result;
+		for (size_t i = 0; i < word_count; ++i)
+			result._words[i] = ~_words[i];
+
+		return result;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bit_mask<_Bits> bit_mask<_Bits>::operator|(const bit_mask& other) const
+	{
+		bit_mask result = *this;
+		return result |= other;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bit_mask<_Bits> bit_mask<_Bits>::operator&(const bit_mask& other) const
+	{
+		bit_mask result = *this;
+		return result &= other;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bit_mask<_Bits> bit_mask<_Bits>::operator^(const bit_mask& other) const
+	{
+		bit_mask result;
+		for (size_t i = 0; i < word_count; ++i)
+			result._words[i] = _words[i] ^ other._words[i];
+
+		return result;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bit_mask<_Bits>& bit_mask<_Bits>::operator|=(const bit_mask& other)
+	{
+		for (size_t i = 0; i < word_count; ++i)
+			_words[i] |= other._words[i];
+
+		return *this;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bit_mask<_Bits>& bit_mask<_Bits>::operator&=(const bit_mask& other)
+	{
+		for (size_t i = 0; i < word_count; ++i)
+			_words[i] &= other._words[i];
+
+		return *this;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bool bit_mask<_Bits>::operator==(const bit_mask& other) const
+	{
+		uint64_t difference = 0;
+		for (size_t i = 0; i < word_count; ++i)
+			difference |= _words[i] ^ other._words[i];
+
+		return difference == 0;
+	}
+
+	template<size_t _Bits>
+	inline constexpr bool bit_mask<_Bits>::operator!=(const bit_mask& other) const
+	{
+		return !(*this == other);
+	}
+
+	template<size_t _Bits>
+	inline constexpr bool bit_mask<_Bits>::operator<(const bit_mask& other) const
+	{
+		for (size_t i = 0; i < word_count; ++i)
+		{
+			if (_words[i] != other._words[i])
+				return _words[i] < other._words[i];
+		}
+
+		return false;
+	}
+}
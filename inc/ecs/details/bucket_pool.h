@@ -0,0 +1,206 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+
+#include "../config.h"
+#include "../memory_resource.h"
+
+namespace ecs::details
+{
+	// Bucket memory of a single archetype, carved from slabs that double in size up to `max_slab_buckets`.
+	// An archetype only ever adds or removes its last bucket, so the free list is a stack: the bucket released last
+	// is handed out first, bucket `i` always lives at the same address and consecutive buckets are adjacent within a slab.
+	// Slabs come from a `memory_resource` and are only freed by `shrink`, letting the owner decide how much to keep around.
+	class bucket_pool
+	{
+	private:
+		struct slab
+		{
+			uint8_t* _data;
+			size_t _count;
+		};
+
+		std::vector<slab> _slabs;
+
+		memory_resource* _resource = &memory_resource::default_resource();
+
+		// bytes between two buckets, a multiple of the bucket alignment
+		size_t _stride = 0;
+
+		size_t _alignment = config::bucket_alignment;
+
+		// buckets in all slabs
+		size_t _capacity = 0;
+
+		// buckets handed out, always the first ones in slab order
+		size_t _used = 0;
+
+		// adds a slab of at least `count` buckets, grown to fill the granularity of the resource
+		void add_slab(size_t count);
+
+		void free_slab(const slab& slab);
+
+	public:
+		static constexpr size_t max_slab_buckets = 64;
+
+		bucket_pool() = default;
+		bucket_pool(const bucket_pool&) = delete;
+		bucket_pool& operator=(const bucket_pool&) = delete;
+		bucket_pool(bucket_pool&& other) noexcept;
+		bucket_pool& operator=(bucket_pool&& other) noexcept;
+		~bucket_pool();
+
+		// sets the byte size and alignment (a power of 2) of a bucket, must be called before the first allocation
+		void initialize(size_t bucketSize, size_t alignment);
+
+		// sets where the slabs come from, must be called before the first allocation
+		void set_resource(memory_resource& resource);
+
+		// buckets handed out
+		size_t size() const;
+
+		// buckets available without allocating a slab
+		size_t capacity() const;
+
+		// returns the next bucket in memory order, its memory is left uninitialized
+		void* allocate();
+
+		// returns the last allocated bucket to the pool
+		void release();
+
+		// makes sure `count` buckets in total are available, missing ones are added as a single slab
+		void reserve(size_t count);
+
+		// makes sure `count` buckets in total are available, missing ones are added as slabs of at most `max_slab_buckets`
+		// that `shrink` can free one by one again
+		void grow(size_t count);
+
+		// frees trailing unused slabs as long as at least `keep` buckets remain available
+		void shrink(size_t keep);
+	};
+
+	inline bucket_pool::bucket_pool(bucket_pool&& other) noexcept
+		: _slabs(std::move(other._slabs))
+		, _resource(other._resource)
+		, _stride(other._stride)
+		, _alignment(other._alignment)
+		, _capacity(std::exchange(other._capacity, 0))
+		, _used(std::exchange(other._used, 0))
+	{
+		other._slabs.clear();
+	}
+
+	inline bucket_pool& bucket_pool::operator=(bucket_pool&& other) noexcept
+	{
+		if (this != &other)
+		{
+			for (auto& slab : _slabs)
+				free_slab(slab);
+
+			_slabs = std::move(other._slabs);
+			_resource = other._resource;
+			_stride = other._stride;
+			_alignment = other._alignment;
+			_capacity = std::exchange(other._capacity, 0);
+			_used = std::exchange(other._used, 0);
+			other._slabs.clear();
+		}
+
+		return *this;
+	}
+
+	inline bucket_pool::~bucket_pool()
+	{
+		for (auto& slab : _slabs)
+			free_slab(slab);
+	}
+
+	inline void bucket_pool::initialize(size_t bucketSize, size_t alignment)
+	{
+		assert(_slabs.empty() && (alignment & (alignment - 1)) == 0);
+		_alignment = std::max(alignment, config::bucket_alignment);
+		_stride = (bucketSize + _alignment - 1) & ~(_alignment - 1);
+	}
+
+	inline void bucket_pool::set_resource(memory_resource& resource)
+	{
+		assert(_slabs.empty());
+		_resource = &resource;
+	}
+
+	inline size_t bucket_pool::size() const
+	{
+		return _used;
+	}
+
+	inline size_t bucket_pool::capacity() const
+	{
+		return _capacity;
+	}
+
+	inline void bucket_pool::add_slab(size_t count)
+	{
+		assert(_stride != 0);
+
+		const size_t granularity = _resource->granularity();
+		count = ((count * _stride + granularity - 1) / granularity * granularity) / _stride;
+
+		_slabs.push_back({ static_cast<uint8_t*>(_resource->allocate(count * _stride, _alignment)), count });
+		_capacity += count;
+	}
+
+	inline void bucket_pool::free_slab(const slab& slab)
+	{
+		_resource->deallocate(slab._data, slab._count * _stride);
+	}
+
+	inline void* bucket_pool::allocate()
+	{
+		if (_used == _capacity)
+			add_slab(std::clamp<size_t>(_capacity, 1, max_slab_buckets));
+
+		// the next bucket is almost always in the last slab
+		size_t first = _capacity;
+		for (auto slab = _slabs.rbegin(); ; ++slab)
+		{
+			first -= slab->_count;
+			if (_used >= first)
+				return slab->_data + (_used++ - first) * _stride;
+		}
+	}
+
+	inline void bucket_pool::release()
+	{
+		assert(_used > 0);
+		--_used;
+	}
+
+	inline void bucket_pool::reserve(size_t count)
+	{
+		if (count > _capacity)
+			add_slab(count - _capacity);
+	}
+
+	inline void bucket_pool::grow(size_t count)
+	{
+		while (count > _capacity)
+			add_slab(std::min(count - _capacity, max_slab_buckets));
+	}
+
+	inline void bucket_pool::shrink(size_t keep)
+	{
+		keep = std::max(keep, _used);
+
+		while (!_slabs.empty() && _capacity - _slabs.back()._count >= keep)
+		{
+			_capacity -= _slabs.back()._count;
+			free_slab(_slabs.back());
+			_slabs.pop_back();
+		}
+	}
+}
@@ -192,7 +192,7 @@ namespace ecs::details
 	{
 		bucket_t* bucket = _first;
 
-		for (; index > _BucketCapacity; index -= _BucketCapacity)
+		for (; index >= _BucketCapacity; index -= _BucketCapacity)
 			bucket = bucket->_next;
 
 		return bucket->_data[index];
@@ -259,12 +259,14 @@ namespace ecs::details
 		bucket_t* bucket = _first, * endBucket = _last;
 		size_t size = _size;
 
-		for (; size >= _BucketCapacity; size -= _BucketCapacity, bucket = bucket->_next)
+		for (; size >= _BucketCapacity; size -= _BucketCapacity)
 		{
 			for (size_t i = 0; i < _BucketCapacity; ++i)
 				destruct(bucket->_data[i]);
 
+			bucket_t* next = bucket->_next;
 			delete bucket;
+			bucket = next;
 		}
 		
 		if (size > 0)
@@ -290,7 +292,9 @@ namespace ecs::details
 	template <typename _T, size_t _BucketCapacity, typename _Alloc>
 	inline auto bucket_vector<_T, _BucketCapacity, _Alloc>::end() -> iterator
 	{
-		return iterator(_last, _size % _BucketCapacity);
+		// a full last bucket ends at its (null) successor, matching what operator++ produces
+		const size_t index = _size % _BucketCapacity;
+		return iterator(index != 0 ? _last : nullptr, index);
 	}
 
 	template <typename _T, size_t _BucketCapacity, typename _Alloc>
@@ -302,6 +306,7 @@ namespace ecs::details
 	template <typename _T, size_t _BucketCapacity, typename _Alloc>
 	inline auto bucket_vector<_T, _BucketCapacity, _Alloc>::end() const -> const_iterator
 	{
-		return const_iterator(_last, (_size % _BucketCapacity) + 1);
+		const size_t index = _size % _BucketCapacity;
+		return const_iterator(index != 0 ? _last : nullptr, index);
 	}
 }
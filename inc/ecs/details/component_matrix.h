@@ -1,10 +1,14 @@
 #pragma once
 
+#include <type_traits>
+
 #include "../config.h"
+#include "../utils.h"
 
 namespace ecs::details
 {
-	template<typename _T>
+	// Column of a component in a bucket, sized for the largest bucket capacity, only the archetype's `bucket_capacity()` elements are stored
+	template<typename _T, bool _Tag = is_tag_v<_T>>
 	struct component_row
 	{
 		_T _elements[config::bucket_size];
@@ -13,10 +17,97 @@ namespace ecs::details
 		{
 			return _elements[index];
 		}
+
+		const _T& operator[](size_t index) const
+		{
+			return _elements[index];
+		}
 	};
 
-	template<typename... _Components>
-	struct component_matrix : public component_row<_Components>...
+	// Tags have no storage, every element refers to the same instance
+	template<typename _T>
+	struct component_row<_T, true>
 	{
+		static inline _T _instance{};
+
+		_T& operator[](size_t)
+		{
+			return _instance;
+		}
+
+		const _T& operator[](size_t) const
+		{
+			return _instance;
+		}
 	};
+
+	// The valid elements of a component row, handed out by `world::query_chunks`, `component_span<const T>` only reads them
+	template<typename _T, bool _Tag = is_tag_v<std::remove_const_t<_T>>>
+	class component_span
+	{
+	private:
+		_T* _data;
+		size_t _size;
+
+	public:
+		constexpr component_span(_T* data, size_t size)
+			: _data(data)
+			, _size(size)
+		{
+		}
+
+		constexpr _T& operator[](size_t index) const
+		{
+			return _data[index];
+		}
+
+		constexpr _T* data() const
+		{
+			return _data;
+		}
+
+		constexpr size_t size() const
+		{
+			return _size;
+		}
+
+		constexpr _T* begin() const
+		{
+			return _data;
+		}
+
+		constexpr _T* end() const
+		{
+			return _data + _size;
+		}
+	};
+
+	// Tags have no storage, every element refers to the same instance
+	template<typename _T>
+	class component_span<_T, true>
+	{
+	private:
+		size_t _size;
+
+	public:
+		constexpr component_span(_T*, size_t size)
+			: _size(size)
+		{
+		}
+
+		constexpr _T& operator[](size_t) const
+		{
+			return component_row<std::remove_const_t<_T>>::_instance;
+		}
+
+		constexpr size_t size() const
+		{
+			return _size;
+		}
+	};
+}
+
+namespace ecs
+{
+	using details::component_span;
 }
\ No newline at end of file
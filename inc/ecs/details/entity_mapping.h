@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+#include "archetype_storage.h"
+
+namespace ecs::details
+{
+	// Entity id to `entity_target` table, stored in fixed size pages.
+	// Pages are allocated when the first id in their range is, growing never copies and targets never move.
+	// Freed ids form an intrusive LIFO list through their unused targets (`_index` is the next free id),
+	// the most recently freed and likely still cached target is handed out first.
+	class entity_mapping
+	{
+	private:
+		// 32 KB pages
+		static constexpr size_t page_size = 4096;
+
+		static constexpr uint32_t npos = ~uint32_t(0);
+
+		std::vector<std::unique_ptr<entity_target[]>> _pages;
+		size_t _size = 0;
+
+		// head of the free list
+		uint32_t _free = npos;
+
+	public:
+		// amount of ids in the table
+		size_t size() const;
+
+		// allocates the pages for `size` ids without adding them to the table
+		void reserve(size_t size);
+
+		// grows the table to hold `size` ids, new targets are zero initialized
+		void resize(size_t size);
+
+		entity_target& operator[](size_t id);
+
+		const entity_target& operator[](size_t id) const;
+
+		// returns a free id, reusing the last freed one if there is any
+		uint32_t allocate();
+
+		// writes `count` free ids to `out`, reused ids first followed by a single range of new ones
+		template<typename _OutputIt>
+		_OutputIt allocate(size_t count, _OutputIt out);
+
+		// invalidates the target and puts the id on the free list
+		void free(uint32_t id);
+	};
+
+	inline size_t entity_mapping::size() const
+	{
+		return _size;
+	}
+
+	inline void entity_mapping::reserve(size_t size)
+	{
+		const size_t pageCount = (size + page_size - 1) / page_size;
+		while (_pages.size() < pageCount)
+			_pages.emplace_back(new entity_target[page_size]());
+	}
+
+	inline void entity_mapping::resize(size_t size)
+	{
+		reserve(size);
+
+		if (size > _size)
+			_size = size;
+	}
+
+	inline uint32_t entity_mapping::allocate()
+	{
+		if (_free != npos)
+		{
+			const uint32_t id = _free;
+			_free = (*this)[id]._index;
+			return id;
+		}
+
+		const uint32_t id = uint32_t(_size);
+		resize(_size + 1);
+		return id;
+	}
+
+	template<typename _OutputIt>
+	inline _OutputIt entity_mapping::allocate(size_t count, _OutputIt out)
+	{
+		for (; count > 0 && _free != npos; --count)
+		{
+			*out++ = _free;
+			_free = (*this)[_free]._index;
+		}
+
+		const uint32_t first = uint32_t(_size);
+		resize(_size + count);
+
+		for (uint32_t id = first; id < _size; ++id)
+			*out++ = id;
+
+		return out;
+	}
+
+	inline void entity_mapping::free(uint32_t id)
+	{
+		auto& target = (*this)[id];
+		target.invalidate();
+		target._index = _free;
+		_free = id;
+	}
+
+	inline entity_target& entity_mapping::operator[](size_t id)
+	{
+		return _pages[id / page_size][id % page_size];
+	}
+
+	inline const entity_target& entity_mapping::operator[](size_t id) const
+	{
+		return _pages[id / page_size][id % page_size];
+	}
+}
@@ -2,6 +2,9 @@
 
 #include <type_traits>
 
+#include "../utils.h"
+#include "component_matrix.h"
+
 namespace ecs::details
 {
 	template<typename _T, typename... _Args>
@@ -11,25 +14,25 @@ namespace ecs::details
 		_T _func;
 
 	public:
-		constexpr query_func(_T&& func)
+		constexpr query_func(const _T& func)
 			: _func(func)
 		{};
 
 		template<typename... _InvokeArgs>
-		constexpr void operator() (_InvokeArgs&&... args) const { _func(std::forward<_InvokeArgs>(args)...); }
+		constexpr decltype(auto) operator() (_InvokeArgs&&... args) const { return _func(std::forward<_InvokeArgs>(args)...); }
 	};
 
 	// TODO: enable non-lambda member functions
-	template<typename _Func, typename _Ret, typename... _Args>
-	constexpr auto to_query_func(_Func&& func, _Ret(_Func::*)(_Args...))
+	template<typename _Func, typename _Class, typename _Ret, typename... _Args>
+	constexpr auto to_query_func(_Func&& func, _Ret(_Class::*)(_Args...))
 	{
-		return query_func<_Func, std::decay_t<_Args>...>(std::forward<_Func>(func));
+		return query_func<std::decay_t<_Func>, std::decay_t<_Args>...>(std::forward<_Func>(func));
 	}
 
-	template<typename _Func, typename _Ret, typename... _Args>
-	constexpr auto to_query_func(_Func&& func, _Ret(_Func::*)(_Args...) const)
+	template<typename _Func, typename _Class, typename _Ret, typename... _Args>
+	constexpr auto to_query_func(_Func&& func, _Ret(_Class::*)(_Args...) const)
 	{
-		return query_func<_Func, std::decay_t<_Args>...>(std::forward<_Func>(func));
+		return query_func<std::decay_t<_Func>, std::decay_t<_Args>...>(std::forward<_Func>(func));
 	}
 
 	template<typename _Ret, typename... _Args>
@@ -41,6 +44,48 @@ namespace ecs::details
 	template<typename _Func>
 	constexpr auto to_query_func(_Func&& func)
 	{
-		return to_query_func(std::forward<_Func>(func), &_Func::operator());
+		return to_query_func(std::forward<_Func>(func), &std::decay_t<_Func>::operator());
 	};
+
+	// Parameter types of the query function, unlike `query_func` these keep their qualifiers,
+	// e.g.: `const T&` is a read and `T&` is a write.
+	template<typename _Func>
+	struct query_params : query_params<decltype(&_Func::operator())> {};
+
+	template<typename _Func, typename _Ret, typename... _Args>
+	struct query_params<_Ret(_Func::*)(_Args...)> { using type = ecs::pack<_Args...>; };
+
+	template<typename _Func, typename _Ret, typename... _Args>
+	struct query_params<_Ret(_Func::*)(_Args...) const> { using type = ecs::pack<_Args...>; };
+
+	template<typename _Ret, typename... _Args>
+	struct query_params<_Ret(*)(_Args...)> { using type = ecs::pack<_Args...>; };
+
+	template<typename _Func>
+	using query_params_t = typename query_params<std::decay_t<_Func>>::type;
+
+	template<typename _T>
+	struct is_mutable_param : std::bool_constant<std::is_lvalue_reference_v<_T> && !std::is_const_v<std::remove_reference_t<_T>>> {};
+
+	template<typename _T>
+	constexpr bool is_mutable_param_v = is_mutable_param<_T>::value;
+
+	// Parameters of chunk query functions:
+	// `size_t` entity count, `component_span<T>` or `component_span<const T>` component rows, and `const entity*` entity ids.
+	template<typename _T>
+	struct chunk_param { using component = ecs::entity; static constexpr bool writes = false; };
+
+	template<typename _T>
+	struct chunk_param<component_span<_T>> { using component = _T; static constexpr bool writes = true; };
+
+	template<typename _T>
+	struct chunk_param<component_span<const _T>> { using component = _T; static constexpr bool writes = false; };
+
+	// the component a chunk parameter refers to, `entity` when it doesn't refer to any
+	template<typename _T>
+	using chunk_component_t = typename chunk_param<std::remove_cv_t<std::remove_reference_t<_T>>>::component;
+
+	// true if the chunk parameter hands out mutable components
+	template<typename _T>
+	constexpr bool chunk_writes_v = chunk_param<std::remove_cv_t<std::remove_reference_t<_T>>>::writes;
 }
\ No newline at end of file
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <array>
+#include <utility>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#include "../config_registry.h"
+
+namespace ecs::details
+{
+	// Paged sparse set of a single component, keyed by entity id.
+	// Both the id lookup and the components are stored in pages that are allocated on first use and never move,
+	// adding and removing is O(1) and erasing moves only the last element into the hole.
+	class sparse_set
+	{
+	private:
+		static constexpr size_t page_size = 4096;
+		static constexpr uint32_t npos = ~uint32_t(0);
+
+		uint16_t _component;
+		uint16_t _size;
+		bool _relocatable;
+
+		// entity id to dense index, npos when absent
+		std::vector<std::unique_ptr<uint32_t[]>> _sparse;
+
+		// dense index to entity id
+		std::vector<uint32_t> _ids;
+
+		// dense component storage, empty for tags
+		std::vector<std::unique_ptr<std::max_align_t[]>> _dense;
+
+		uint32_t dense_index(uint32_t id) const;
+
+	public:
+		explicit sparse_set(size_t component);
+		sparse_set(sparse_set&&) = default;
+		sparse_set& operator=(sparse_set&&) = default;
+		~sparse_set();
+
+		size_t component() const;
+
+		size_t size() const;
+
+		bool contains(uint32_t id) const;
+
+		// entity id of the dense element
+		uint32_t id(size_t index) const;
+
+		// component of the dense element, nullptr for tags
+		void* get(size_t index) const;
+
+		// component of the entity, nullptr if it's absent or a tag
+		void* find(uint32_t id) const;
+
+		// adds the entity, which must not be present already, and returns its unconstructed component (nullptr for tags)
+		void* allocate(uint32_t id);
+
+		// destroys the component of the entity and fills its hole with the last element, returns false if it was absent
+		bool erase(uint32_t id);
+
+		void clear();
+	};
+
+	// Sparse sets of all sparse components of the registry, in registry order
+	template<size_t... _Indices>
+	inline std::array<sparse_set, sizeof...(_Indices)> make_sparse_sets(std::index_sequence<_Indices...>)
+	{
+		return { sparse_set(config::registry::_sparse_components[_Indices])... };
+	}
+
+	inline sparse_set::sparse_set(size_t component)
+		: _component(uint16_t(component))
+		, _size(config::registry::_component_size[component])
+		, _relocatable(config::registry::_component_relocatable[component])
+	{
+	}
+
+	inline sparse_set::~sparse_set()
+	{
+		clear();
+	}
+
+	inline uint32_t sparse_set::dense_index(uint32_t id) const
+	{
+		const size_t page = id / page_size;
+		return page < _sparse.size() && _sparse[page]
+			? _sparse[page][id % page_size]
+			: npos;
+	}
+
+	inline size_t sparse_set::component() const
+	{
+		return _component;
+	}
+
+	inline size_t sparse_set::size() const
+	{
+		return _ids.size();
+	}
+
+	inline bool sparse_set::contains(uint32_t id) const
+	{
+		return dense_index(id) != npos;
+	}
+
+	inline uint32_t sparse_set::id(size_t index) const
+	{
+		return _ids[index];
+	}
+
+	inline void* sparse_set::get(size_t index) const
+	{
+		if (_size == 0)
+			return nullptr;
+
+		return reinterpret_cast<uint8_t*>(_dense[index / page_size].get()) + (index % page_size) * _size;
+	}
+
+	inline void* sparse_set::find(uint32_t id) const
+	{
+		const uint32_t index = dense_index(id);
+		return index != npos ? get(index) : nullptr;
+	}
+
+	inline void* sparse_set::allocate(uint32_t id)
+	{
+		const size_t page = id / page_size;
+		if (page >= _sparse.size())
+			_sparse.resize(page + 1);
+
+		if (!_sparse[page])
+		{
+			_sparse[page].reset(new uint32_t[page_size]);
+			std::fill(_sparse[page].get(), _sparse[page].get() + page_size, npos);
+		}
+
+		const uint32_t index = uint32_t(_ids.size());
+		_sparse[page][id % page_size] = index;
+		_ids.push_back(id);
+
+		if (_size == 0)
+			return nullptr;
+
+		if (index / page_size >= _dense.size())
+			_dense.emplace_back(new std::max_align_t[(page_size * _size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)]);
+
+		return get(index);
+	}
+
+	inline bool sparse_set::erase(uint32_t id)
+	{
+		const uint32_t index = dense_index(id);
+		if (index == npos)
+			return false;
+
+		const uint32_t last = uint32_t(_ids.size() - 1);
+
+		if (_size != 0)
+		{
+			void* hole = get(index);
+
+			if (!_relocatable)
+				config::registry::_component_destruct[_component](hole);
+
+			if (index != last)
+			{
+				if (_relocatable)
+					std::memcpy(hole, get(last), _size);
+				else
+					config::registry::_component_relocate[_component](hole, get(last));
+			}
+		}
+
+		const uint32_t moved = _ids[last];
+		_ids[index] = moved;
+		_sparse[moved / page_size][moved % page_size] = index;
+		_sparse[id / page_size][id % page_size] = npos;
+		_ids.pop_back();
+
+		return true;
+	}
+
+	inline void sparse_set::clear()
+	{
+		if (_size != 0 && !_relocatable)
+		{
+			for (size_t i = 0; i < _ids.size(); ++i)
+				config::registry::_component_destruct[_component](get(i));
+		}
+
+		_ids.clear();
+		_sparse.clear();
+		_dense.clear();
+	}
+}
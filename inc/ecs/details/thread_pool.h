@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ecs::details
+{
+	// Work-stealing thread pool, the calling thread participates in the work.
+	// Each participant owns a contiguous range of task indices, when it runs dry it steals half of the range of another.
+	class thread_pool
+	{
+	private:
+		struct alignas(64) task_range
+		{
+			std::mutex _mutex;
+			size_t _begin = 0;
+			size_t _end = 0;
+		};
+
+		using invoke_t = void(*)(void*, size_t);
+
+		std::vector<std::thread> _threads;
+		std::unique_ptr<task_range[]> _ranges;
+		size_t _range_count;
+
+		std::mutex _submit_mutex;
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::condition_variable _done;
+
+		invoke_t _invoke = nullptr;
+		void* _context = nullptr;
+		size_t _generation = 0;
+		size_t _pending = 0;
+		bool _stop = false;
+
+		// first exception thrown by a task of the current run, rethrown on the calling thread
+		std::exception_ptr _exception;
+
+		static inline thread_local bool _inside_pool = false;
+		static inline thread_local size_t _participant = 0;
+
+		// threaded runs so far, over all pools
+		static inline std::atomic<uint32_t> _runs = 0;
+
+		// run and task index of the current task, the task is all ones in between runs
+		static inline thread_local uint64_t _task_key = ~uint32_t(0);
+		uint64_t _run = 0;
+
+		template<typename _Func>
+		static void invoke(void* context, size_t index);
+
+		bool pop(size_t participant, size_t& task);
+
+		bool steal(size_t participant, size_t& task);
+
+		// keeps the first exception and drops all tasks that haven't started yet
+		void fail(std::exception_ptr exception);
+
+		void work(size_t participant);
+
+		void worker_main(size_t participant);
+
+	public:
+		explicit thread_pool(size_t thread_count = 0);
+		~thread_pool();
+
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+
+		// amount of participants, including the calling thread
+		size_t size() const;
+
+		// index of the participant executing the current task, in [0, size()), e.g.: for per-thread buffers
+		static size_t participant();
+
+		// position of the current task: grows with every run and, within a run, with the task index.
+		// Unlike `participant()` it doesn't depend on which thread picked up the task, nested and serial runs keep the key of their caller
+		static uint64_t task_key();
+
+		// calls `func(i)` for every i in [0, count), returns when all calls are done,
+		// nested calls from within a task are executed on the calling thread.
+		// If a call throws, tasks that haven't started are skipped and the first exception is rethrown once all others are done
+		template<typename _Func>
+		void run(size_t count, _Func&& func);
+	};
+
+	inline thread_pool::thread_pool(size_t thread_count)
+	{
+		if (thread_count == 0)
+			thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+		_range_count = thread_count;
+		_ranges = std::make_unique<task_range[]>(_range_count);
+
+		_threads.reserve(thread_count - 1);
+		for (size_t i = 1; i < thread_count; ++i)
+			_threads.emplace_back(&thread_pool::worker_main, this, i);
+	}
+
+	inline thread_pool::~thread_pool()
+	{
+		{
+			std::lock_guard lock(_mutex);
+			_stop = true;
+		}
+
+		_wake.notify_all();
+
+		for (auto& thread : _threads)
+			thread.join();
+	}
+
+	inline size_t thread_pool::size() const
+	{
+		return _range_count;
+	}
+
+	inline size_t thread_pool::participant()
+	{
+		return _participant;
+	}
+
+	inline uint64_t thread_pool::task_key()
+	{
+		return _task_key;
+	}
+
+	template<typename _Func>
+	inline void thread_pool::invoke(void* context, size_t index)
+	{
+		(*static_cast<std::remove_reference_t<_Func>*>(context))(index);
+	}
+
+	inline bool thread_pool::pop(size_t participant, size_t& task)
+	{
+		auto& range = _ranges[participant];
+		std::lock_guard lock(range._mutex);
+
+		if (range._begin < range._end)
+		{
+			task = range._begin++;
+			return true;
+		}
+
+		return false;
+	}
+
+	inline bool thread_pool::steal(size_t participant, size_t& task)
+	{
+		for (size_t i = 1; i < _range_count; ++i)
+		{
+			auto& victim = _ranges[(participant + i) % _range_count];
+			size_t begin, end;
+			{
+				std::lock_guard lock(victim._mutex);
+				if (victim._begin >= victim._end)
+					continue;
+
+				// take the upper half, the victim keeps working on the lower half in order
+				begin = victim._begin + (victim._end - victim._begin) / 2;
+				end = victim._end;
+				victim._end = begin;
+			}
+
+			auto& own = _ranges[participant];
+			{
+				std::lock_guard lock(own._mutex);
+				own._begin = begin + 1;
+				own._end = end;
+			}
+
+			task = begin;
+			return true;
+		}
+
+		return false;
+	}
+
+	inline void thread_pool::fail(std::exception_ptr exception)
+	{
+		{
+			std::lock_guard lock(_mutex);
+			if (!_exception)
+				_exception = std::move(exception);
+		}
+
+		for (size_t i = 0; i < _range_count; ++i)
+		{
+			std::lock_guard lock(_ranges[i]._mutex);
+			_ranges[i]._begin = _ranges[i]._end;
+		}
+	}
+
+	inline void thread_pool::work(size_t participant)
+	{
+		size_t task;
+		while (pop(participant, task) || steal(participant, task))
+		{
+			try
+			{
+				_task_key = _run | task;
+				_invoke(_context, task);
+			}
+			catch (...)
+			{
+				fail(std::current_exception());
+			}
+		}
+	}
+
+	inline void thread_pool::worker_main(size_t participant)
+	{
+		_inside_pool = true;
+		_participant = participant;
+
+		for (size_t generation = 0; ; )
+		{
+			{
+				std::unique_lock lock(_mutex);
+				_wake.wait(lock, [&] { return _stop || _generation != generation; });
+
+				if (_stop)
+					return;
+
+				generation = _generation;
+			}
+
+			work(participant);
+
+			{
+				std::lock_guard lock(_mutex);
+				if (--_pending == 0)
+					_done.notify_one();
+			}
+		}
+	}
+
+	template<typename _Func>
+	inline void thread_pool::run(size_t count, _Func&& func)
+	{
+		if (count == 0)
+			return;
+
+		if (_inside_pool || _threads.empty() || count == 1)
+		{
+			for (size_t i = 0; i < count; ++i)
+				func(i);
+
+			return;
+		}
+
+		std::lock_guard submit(_submit_mutex);
+
+		// all workers are idle, hand out contiguous ranges
+		for (size_t i = 0; i < _range_count; ++i)
+		{
+			_ranges[i]._begin = count * i / _range_count;
+			_ranges[i]._end = count * (i + 1) / _range_count;
+		}
+
+		{
+			std::lock_guard lock(_mutex);
+			_invoke = &invoke<_Func>;
+			_context = const_cast<void*>(static_cast<const void*>(std::addressof(func)));
+			_pending = _threads.size();
+			_run = uint64_t(++_runs) << 32;
+			++_generation;
+		}
+
+		_wake.notify_all();
+
+		{
+			// reset even when unwinding, later runs on this thread would be serial otherwise
+			struct inside_scope
+			{
+				inside_scope() { _inside_pool = true; }
+				~inside_scope() { _inside_pool = false; }
+			} inside;
+
+			work(0);
+		}
+
+		std::exception_ptr exception;
+		{
+			// wait for every worker to leave this generation, so no one can pick up stale tasks later on
+			// and `func` outlives all calls to it
+			std::unique_lock lock(_mutex);
+			_done.wait(lock, [&] { return _pending == 0; });
+			exception = std::exchange(_exception, nullptr);
+		}
+
+		// work recorded after the run comes after all of its tasks
+		_task_key = _run | ~uint32_t(0);
+
+		if (exception)
+			std::rethrow_exception(exception);
+	}
+}
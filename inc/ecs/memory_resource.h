@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace ecs
+{
+	// Source of the slabs archetype buckets are carved from, see `world::set_memory_resource`.
+	// Must outlive every world (archetype) that allocated from it.
+	class memory_resource
+	{
+	public:
+		virtual ~memory_resource() = default;
+
+		// `size` is a multiple of `alignment`, a power of 2 no larger than 4096
+		virtual void* allocate(size_t size, size_t alignment) = 0;
+
+		virtual void deallocate(void* ptr, size_t size) = 0;
+
+		// preferred allocation unit, slabs are grown to fill it
+		virtual size_t granularity() const { return 1; }
+
+		// aligned heap allocations, used unless a world is given another resource
+		static memory_resource& default_resource();
+	};
+
+	// Aligned heap allocations, `aligned_alloc` or `_aligned_malloc`
+	class aligned_memory_resource : public memory_resource
+	{
+	public:
+		void* allocate(size_t size, size_t alignment) override;
+
+		void deallocate(void* ptr, size_t size) override;
+	};
+
+	// 2 MB huge pages, reducing TLB misses when iterating large archetypes.
+	// Transparent mode maps 2 MB aligned memory and advises the kernel to back it with huge pages (MADV_HUGEPAGE),
+	// explicit mode uses the reserved pool (MAP_HUGETLB, see /proc/sys/vm/nr_hugepages) and falls back to transparent when it's exhausted.
+	// Optionally prefers a NUMA node for all its memory, e.g.: the node of the thread that iterates it most.
+	// Only Linux is supported, other platforms fall back to `aligned_memory_resource`.
+	class huge_page_memory_resource : public memory_resource
+	{
+	public:
+		enum class mode : uint8_t
+		{
+			transparent,
+			explicit_pages,
+		};
+
+		static constexpr size_t page_size = size_t(2) << 20;
+
+		static constexpr int no_node = -1;
+
+	private:
+		mode _mode;
+		int _numa_node;
+
+		void bind(void* ptr, size_t size) const;
+
+	public:
+		explicit huge_page_memory_resource(mode mode = mode::transparent, int numaNode = no_node);
+
+		void* allocate(size_t size, size_t alignment) override;
+
+		void deallocate(void* ptr, size_t size) override;
+
+		size_t granularity() const override;
+
+		// NUMA node of the cpu the calling thread runs on, `no_node` if unknown
+		static int current_numa_node();
+	};
+}
+
+#include "memory_resource.inl"
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "memory_resource.h"
+
+#include <new>
+#include <cstdlib>
+#include <iterator>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ecs
+{
+	inline memory_resource& memory_resource::default_resource()
+	{
+		static aligned_memory_resource resource;
+		return resource;
+	}
+
+	inline void* aligned_memory_resource::allocate(size_t size, size_t alignment)
+	{
+#if _WIN32
+		void* ptr = _aligned_malloc(size, alignment);
+#else
+		void* ptr = aligned_alloc(alignment, size);
+#endif
+		if (ptr == nullptr)
+			throw std::bad_alloc();
+
+		return ptr;
+	}
+
+	inline void aligned_memory_resource::deallocate(void* ptr, size_t)
+	{
+#if _WIN32
+		_aligned_free(ptr);
+#else
+		free(ptr);
+#endif
+	}
+
+	inline huge_page_memory_resource::huge_page_memory_resource(mode mode, int numaNode)
+		: _mode(mode)
+		, _numa_node(numaNode)
+	{
+	}
+
+#if defined(__linux__)
+	inline void huge_page_memory_resource::bind(void* ptr, size_t size) const
+	{
+		if (_numa_node == no_node)
+			return;
+
+		// mbind(MPOL_PREFERRED) without depending on libnuma, pages are placed on the node when first touched
+		constexpr int mpolPreferred = 1;
+		constexpr size_t maskBits = sizeof(unsigned long) * 8;
+
+		unsigned long mask[16] = {};
+		if (size_t(_numa_node) >= std::size(mask) * maskBits)
+			return;
+
+		mask[_numa_node / maskBits] = 1ul << (_numa_node % maskBits);
+		syscall(SYS_mbind, ptr, size, mpolPreferred, mask, std::size(mask) * maskBits, 0);
+	}
+
+	inline void* huge_page_memory_resource::allocate(size_t size, size_t)
+	{
+		size = (size + page_size - 1) & ~(page_size - 1);
+
+		if (_mode == mode::explicit_pages)
+		{
+			void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (ptr != MAP_FAILED)
+			{
+				bind(ptr, size);
+				return ptr;
+			}
+		}
+
+		// over map by a page and trim both ends, transparent huge pages need 2 MB aligned ranges
+		const size_t mapped = size + page_size;
+		void* raw = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw == MAP_FAILED)
+			throw std::bad_alloc();
+
+		const uintptr_t start = uintptr_t(raw), end = start + mapped;
+		const uintptr_t first = (start + page_size - 1) & ~uintptr_t(page_size - 1), last = first + size;
+
+		if (first > start)
+			munmap(raw, first - start);
+		if (end > last)
+			munmap(reinterpret_cast<void*>(last), end - last);
+
+		void* ptr = reinterpret_cast<void*>(first);
+		madvise(ptr, size, MADV_HUGEPAGE);
+		bind(ptr, size);
+
+		return ptr;
+	}
+
+	inline void huge_page_memory_resource::deallocate(void* ptr, size_t size)
+	{
+		munmap(ptr, (size + page_size - 1) & ~(page_size - 1));
+	}
+
+	inline size_t huge_page_memory_resource::granularity() const
+	{
+		return page_size;
+	}
+
+	inline int huge_page_memory_resource::current_numa_node()
+	{
+		unsigned cpu = 0, node = 0;
+		return syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 ? int(node) : no_node;
+	}
+#else
+	inline void huge_page_memory_resource::bind(void*, size_t) const
+	{
+	}
+
+	inline void* huge_page_memory_resource::allocate(size_t size, size_t alignment)
+	{
+		return default_resource().allocate(size, alignment);
+	}
+
+	inline void huge_page_memory_resource::deallocate(void* ptr, size_t size)
+	{
+		default_resource().deallocate(ptr, size);
+	}
+
+	inline size_t huge_page_memory_resource::granularity() const
+	{
+		return default_resource().granularity();
+	}
+
+	inline int huge_page_memory_resource::current_numa_node()
+	{
+		return no_node;
+	}
+#endif
+}
@@ -1,28 +1,91 @@
 #pragma once
 
+#include <new>
+#include <array>
+#include <utility>
+
 #include "utils.h"
+#include "details/bit_mask.h"
 
 namespace ecs
 {
 	class entity;
 
+	namespace details
+	{
+		// registry indices of the sparse components
+		template<size_t _Count, typename... _Components>
+		constexpr std::array<uint16_t, _Count> sparse_components()
+		{
+			constexpr bool sparse[] = { is_sparse_v<_Components>... };
+
+			std::array<uint16_t, _Count> components{};
+			for (size_t i = 0, s = 0; i < sizeof...(_Components); ++i)
+			{
+				if (sparse[i])
+					components[s++] = uint16_t(i);
+			}
+
+			return components;
+		}
+
+		// index of each component in `sparse_components`, only valid for the sparse ones
+		template<typename... _Components>
+		constexpr std::array<uint16_t, sizeof...(_Components)> sparse_indices()
+		{
+			constexpr bool sparse[] = { is_sparse_v<_Components>... };
+
+			std::array<uint16_t, sizeof...(_Components)> indices{};
+			for (size_t i = 0, s = 0; i < sizeof...(_Components); ++i)
+				indices[i] = uint16_t(sparse[i] ? s++ : s);
+
+			return indices;
+		}
+	}
+
 	template<typename... _Components>
 	class registry
 	{
 	public:
 		using components = pack<_Components...>;
 
-		constexpr static uint16_t _component_size[sizeof...(_Components)] = { sizeof(_Components)... };
+		// tags have no storage and are therefore of size 0
+		constexpr static uint16_t _component_size[sizeof...(_Components)] = { (is_tag_v<_Components> ? 0 : sizeof(_Components))... };
+		constexpr static uint16_t _component_alignment[sizeof...(_Components)] = { uint16_t(alignof(_Components))... };
+
+	private:
+		template<typename _T>
+		static void relocate(void* to, void* from);
+
+		template<typename _T>
+		static void destruct(void* object);
+
+	public:
+		// Type-erased component operations, used by runtime paths like archetype transitions
+		// relocatable components can be moved with a plain memcpy, there's no need to call relocate/destruct on them
+		constexpr static bool _component_relocatable[sizeof...(_Components)] = { (is_tag_v<_Components> || std::is_trivially_copyable_v<_Components>)... };
+		constexpr static void(*_component_relocate[sizeof...(_Components)])(void*, void*) = { &relocate<_Components>... };
+		constexpr static void(*_component_destruct[sizeof...(_Components)])(void*) = { &destruct<_Components>... };
 
 		// Get the amount of components
 		constexpr static size_t count = sizeof...(_Components);
 
+		// Component mask type, wide enough for all components
+		using mask_type = details::bit_mask<details::bit_mask_width(count)>;
+
+		// Components stored in sparse sets instead of archetypes, see `ecs::sparse_storage`
+		constexpr static bool _component_sparse[sizeof...(_Components)] = { is_sparse_v<_Components>... };
+		constexpr static size_t sparse_count = (size_t(0) + ... + size_t(is_sparse_v<_Components>));
+		constexpr static std::array<uint16_t, sparse_count> _sparse_components = details::sparse_components<sparse_count, _Components...>();
+		constexpr static std::array<uint16_t, count> _sparse_index = details::sparse_indices<_Components...>();
+		constexpr static mask_type sparse_mask = (mask_type() | ... | (is_sparse_v<_Components> ? mask_type::bit(::ecs::param_index<_Components, _Components...>::value) : mask_type()));
+
 		// Get the amount of components, STL style
 		constexpr static size_t size();
 
 		// Get the registry index of the component
 		template<typename _T, typename = std::enable_if_t<std::disjunction_v<is_entity<_T>, std::is_same<_T, _Components>...>>>
-		constexpr static uint8_t index_of = std::conditional_t<is_entity_v<_T>, std::integral_constant<size_t, 0>, ::ecs::param_index<_T, _Components...>>::value;
+		constexpr static uint16_t index_of = std::conditional_t<is_entity_v<_T>, std::integral_constant<size_t, 0>, ::ecs::param_index<_T, _Components...>>::value;
 
 		// Get the registry index of the component
 		template<typename _T>
@@ -30,17 +93,20 @@ namespace ecs
 
 		// Create the bit mask of the given components
 		template<typename... _Ts>
-		constexpr static size_t bit_mask_of = (0 | ... | bit_mask_of<_Ts>);
+		constexpr static mask_type bit_mask_of = (mask_type() | ... | bit_mask_of<_Ts>);
 
 		// Bit mask specialization
-		template<typename _T> constexpr static size_t bit_mask_of<_T> = 1ull << index_of<_T>;
-		template<typename _T> constexpr static size_t bit_mask_of<::ecs::exclude<_T>> = 0;
-		template<> constexpr static size_t bit_mask_of<::ecs::entity> = 0;
+		template<typename _T> constexpr static mask_type bit_mask_of<_T> = mask_type::bit(index_of<_T>);
+		template<typename _T> constexpr static mask_type bit_mask_of<::ecs::exclude<_T>> = mask_type();
+		template<typename _T> constexpr static mask_type bit_mask_of<::ecs::changed<_T>> = mask_type::bit(index_of<_T>);
+		template<typename _T> constexpr static mask_type bit_mask_of<::ecs::added<_T>> = mask_type::bit(index_of<_T>);
+		template<> constexpr static mask_type bit_mask_of<::ecs::entity> = mask_type();
 
 		// Checks if components are within the archetype,
 		// includes will override excludes, e.g.: C overrides exclude<C>.
+		// Sparse components are ignored, archetypes never contain them and they're checked per entity instead.
 		template<typename... _Other, typename... _Extra>
-		constexpr static bool qualifies(size_t mask, pack<_Extra...> = {});
+		static bool qualifies(const mask_type& mask, pack<_Extra...> = {});
 	};
 }
 
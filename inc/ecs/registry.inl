@@ -11,13 +11,29 @@ namespace ecs
 		return count;
 	}
 
+	template<typename... _Components>
+	template<typename _T>
+	inline void registry<_Components...>::relocate(void* to, void* from)
+	{
+		_T& object = *static_cast<_T*>(from);
+		new (to) _T(std::move(object));
+		object.~_T();
+	}
+
+	template<typename... _Components>
+	template<typename _T>
+	inline void registry<_Components...>::destruct(void* object)
+	{
+		static_cast<_T*>(object)->~_T();
+	}
+
 	template<typename... _Components>
 	template<typename... _Other, typename... _Extra>
-	constexpr bool registry<_Components...>::qualifies(size_t mask, pack<_Extra...>)
+	inline bool registry<_Components...>::qualifies(const mask_type& mask, pack<_Extra...>)
 	{
 		// if after masking any exclude bit is still present then the `== include` will fail
-		constexpr size_t include = (0 | ... | bit_mask_of<_Other>) | (0 | ... | bit_mask_of<_Extra>);
-		constexpr size_t both = (0 | ... | bit_mask_of<decay_exclude_t<_Other>>) | (0 | ... | bit_mask_of<decay_exclude_t<_Extra>>);
-		return (mask & both) == include;
+		constexpr mask_type include = ((mask_type() | ... | bit_mask_of<_Other>) | (mask_type() | ... | bit_mask_of<_Extra>)) & ~sparse_mask;
+		constexpr mask_type both = ((mask_type() | ... | bit_mask_of<decay_exclude_t<_Other>>) | (mask_type() | ... | bit_mask_of<decay_exclude_t<_Extra>>)) & ~sparse_mask;
+		return mask_type::masked_equals(mask, both, include);
 	}
 }
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include "config.h"
+#include "world.h"
+#include "details/query_func.h"
+
+namespace ecs
+{
+	// Runs registered systems on the world's thread pool,
+	// systems that don't access the same components (or only read them) are executed at the same time.
+	// A system's parameters define its access: `const T&` and `T` are reads, `T&` is a write.
+	// `changed<T>` and `added<T>` filters see all changes made since the system's previous run.
+	// Systems are called concurrently and should therefore not make any structural changes to the world (emplace, erase, add or remove components),
+	// record them in a `command_buffer` per thread pool participant instead and apply them after `run`.
+	class scheduler
+	{
+	private:
+		struct system
+		{
+			std::function<void(world&, uint32_t)> _run;
+			config::mask_type _read_mask;
+			config::mask_type _write_mask;
+
+			// world tick of the previous run
+			uint32_t _last_run;
+		};
+
+		std::vector<system> _systems;
+
+		// per frame execution plan, systems grouped by the level they can run at
+		std::vector<size_t> _levels;
+		std::vector<size_t> _order;
+		std::vector<size_t> _level_offsets;
+
+		template<typename... _Args>
+		static constexpr config::mask_type read_mask(ecs::pack<_Args...>);
+
+		template<typename... _Args>
+		static constexpr config::mask_type write_mask(ecs::pack<_Args...>);
+
+		template<typename... _Extra>
+		static constexpr config::mask_type filter_mask(ecs::pack<_Extra...>);
+
+		static bool conflicts(const system& first, const system& second);
+
+		void build_graph();
+
+	public:
+		// Register a system, `func` is called like `world.query<_Extra...>(func)` and must not make structural changes to the world.
+		// Systems keep their registration order whenever their access conflicts.
+		template<typename... _Extra, typename _Func>
+		size_t add_system(_Func&& func);
+
+		size_t size() const;
+
+		void clear();
+
+		// Runs all systems once, the world's tick is advanced for every level and once more at the end
+		void run(world& world);
+	};
+}
+
+#include "scheduler.inl"
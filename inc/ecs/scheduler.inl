@@ -0,0 +1,119 @@
+#pragma once
+
+#include "scheduler.h"
+
+#include <algorithm>
+
+namespace ecs
+{
+	template<typename... _Args>
+	inline constexpr config::mask_type scheduler::read_mask(ecs::pack<_Args...>)
+	{
+		return (config::mask_type() | ... | (details::is_mutable_param_v<_Args> ? config::mask_type() : config::registry::template bit_mask_of<std::decay_t<_Args>>));
+	}
+
+	template<typename... _Args>
+	inline constexpr config::mask_type scheduler::write_mask(ecs::pack<_Args...>)
+	{
+		return (config::mask_type() | ... | (details::is_mutable_param_v<_Args> ? config::registry::template bit_mask_of<std::decay_t<_Args>> : config::mask_type()));
+	}
+
+	template<typename... _Extra>
+	inline constexpr config::mask_type scheduler::filter_mask(ecs::pack<_Extra...>)
+	{
+		return (config::mask_type() | ... | (is_change_filter_v<_Extra> ? config::registry::template bit_mask_of<_Extra> : config::mask_type()));
+	}
+
+	inline bool scheduler::conflicts(const system& first, const system& second)
+	{
+		return (first._write_mask & (second._read_mask | second._write_mask)).any()
+			|| (second._write_mask & first._read_mask).any();
+	}
+
+	template<typename... _Extra, typename _Func>
+	inline size_t scheduler::add_system(_Func&& func)
+	{
+		using params = details::query_params_t<_Func>;
+
+		_systems.push_back(system
+		{
+			[func = std::forward<_Func>(func)](world& world, uint32_t since) { world.query<_Extra...>(since, func); },
+			// change filters read the ticks of their component
+			read_mask(params()) | filter_mask(ecs::pack<_Extra...>()),
+			write_mask(params()),
+			0
+		});
+
+		_levels.clear();
+		return _systems.size() - 1;
+	}
+
+	inline size_t scheduler::size() const
+	{
+		return _systems.size();
+	}
+
+	inline void scheduler::clear()
+	{
+		_systems.clear();
+		_levels.clear();
+		_level_offsets.clear();
+	}
+
+	inline void scheduler::build_graph()
+	{
+		const size_t count = _systems.size();
+		_levels.assign(count, 0);
+
+		// a system runs one level after the latest earlier system it conflicts with
+		size_t levelCount = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (size_t j = 0; j < i; ++j)
+			{
+				if (_levels[j] >= _levels[i] && conflicts(_systems[j], _systems[i]))
+					_levels[i] = _levels[j] + 1;
+			}
+
+			levelCount = std::max(levelCount, _levels[i] + 1);
+		}
+
+		// bucket sort the systems by level, keeping registration order within a level
+		_level_offsets.assign(levelCount + 1, 0);
+		for (size_t level : _levels)
+			++_level_offsets[level + 1];
+
+		for (size_t i = 1; i <= levelCount; ++i)
+			_level_offsets[i] += _level_offsets[i - 1];
+
+		_order.resize(count);
+		std::vector<size_t> insert(_level_offsets.begin(), _level_offsets.end() - 1);
+		for (size_t i = 0; i < count; ++i)
+			_order[insert[_levels[i]]++] = i;
+	}
+
+	inline void scheduler::run(world& world)
+	{
+		if (_levels.size() != _systems.size())
+			build_graph();
+
+		auto& pool = world::thread_pool();
+
+		for (size_t level = 0; level + 1 < _level_offsets.size(); ++level)
+		{
+			// a new tick per level, changes of earlier levels are then newer than the last run of any later system
+			const uint32_t tick = world.tick();
+
+			const size_t* systems = _order.data() + _level_offsets[level];
+			pool.run(_level_offsets[level + 1] - _level_offsets[level], [&](size_t i)
+			{
+				auto& system = _systems[systems[i]];
+				system._run(world, system._last_run);
+				system._last_run = tick;
+			});
+		}
+
+		// changes made in between runs are newer than any of the systems' last run
+		world.tick();
+	}
+}
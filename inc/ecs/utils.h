@@ -11,6 +11,12 @@ namespace ecs
 	template<typename _T> struct exclude {};
 	template<typename _T> using ex = exclude<_T>;
 
+	// Only qualify buckets in which the component has been handed out as `T&` since the query's tick, see `world::tick`
+	template<typename _T> struct changed {};
+
+	// Only qualify buckets in which the component has been added to an entity since the query's tick, see `world::tick`
+	template<typename _T> struct added {};
+
 	template<typename... _Ts> struct pack {};
 
 	template<typename _T> struct is_exclude : std::false_type {};
@@ -18,10 +24,35 @@ namespace ecs
 	template<typename _T> using is_exclude_t = typename is_exclude<_T>::type;
 	template<typename _T> constexpr bool is_exclude_v = is_exclude<_T>::value;
 
+	template<typename _T> struct is_changed : std::false_type {};
+	template<typename _T> struct is_changed<changed<_T>> : std::true_type {};
+	template<typename _T> constexpr bool is_changed_v = is_changed<_T>::value;
+
+	template<typename _T> struct is_added : std::false_type {};
+	template<typename _T> struct is_added<added<_T>> : std::true_type {};
+	template<typename _T> constexpr bool is_added_v = is_added<_T>::value;
+
+	template<typename _T> constexpr bool is_change_filter_v = is_changed_v<_T> || is_added_v<_T>;
+	template<typename... _Ts> constexpr bool has_change_filter_v = (is_change_filter_v<_Ts> || ...);
+
+	template<typename _T> struct decay_change_filter { using type = _T; };
+	template<typename _T> struct decay_change_filter<changed<_T>> { using type = _T; };
+	template<typename _T> struct decay_change_filter<added<_T>> { using type = _T; };
+	template<typename _T> using decay_change_filter_t = typename decay_change_filter<_T>::type;
+
 	template<typename _T> struct decay_exclude { using type = _T; };
 	template<typename _T> struct decay_exclude<exclude<_T>> { using type = _T; };
 	template<typename _T> using decay_exclude_t = typename decay_exclude<_T>::type;
 
+	// Tags are empty components, they take part in the archetype mask but have no storage
+	template<typename _T> struct is_tag : std::is_empty<_T> {};
+	template<typename _T> constexpr bool is_tag_v = is_tag<_T>::value;
+
+	// Storage policy, specialize it for components that are added and removed often, e.g.: `template<> struct ecs::sparse_storage<Selected> : std::true_type {};`
+	// These are kept in a sparse set keyed by entity id instead of in the archetypes, toggling them never moves the entity.
+	template<typename _T> struct sparse_storage : std::false_type {};
+	template<typename _T> constexpr bool is_sparse_v = sparse_storage<_T>::value;
+
 	template<typename _T> struct decay_non_entity : std::conditional<std::is_same_v<std::decay_t<_T>, entity>, std::remove_reference_t<_T>, std::decay_t<_T>> {};
 	template<typename _T> using decay_non_entity_t = typename decay_non_entity<_T>::type;
 
@@ -3,19 +3,37 @@
 #include <vector>
 #include <memory>
 #include <queue>
+#include <array>
 #include <unordered_map>
+#include <atomic>
+#include <limits>
 
 #include "registry.h"
 #include "config.h"
+#include "memory_resource.h"
 #include "details/archetype_storage.h"
+#include "details/archetype_map.h"
+#include "details/sparse_set.h"
+#include "details/entity_mapping.h"
 #include "details/bucket_vector.h"
 #include "details/fixed_vector.h"
 #include "details/query_func.h"
+#include "details/thread_pool.h"
 
 namespace ecs
 {
+	class command_buffer;
+
+	template<typename... _Args>
+	class cached_query;
+
 	class world
 	{
+		friend class command_buffer;
+
+		template<typename... _Args>
+		friend class cached_query;
+
 	private:
 		template <bool _Inheritable>
 		struct world_storage_internal_t
@@ -60,18 +78,45 @@ namespace ecs
 
 	private:
 		archetype_vector_type _archetypes;
-		uint32_t _entity_max = 0;
+		details::archetype_map<config::mask_type, details::archetype_storage<>> _archetype_lookup;
+
+		// archetypes by index, `_archetypes` itself has no constant time random access
+		std::vector<details::archetype_storage<>*> _archetype_indices;
 		uint8_t _world_index;
 
-		std::vector<details::entity_target> _entity_mapping;
-		std::queue<uint32_t> _entity_mapping_queue;
+		// change tick, stamped onto buckets whose components are added or handed out as `T&`
+		uint32_t _tick = 1;
+
+		details::entity_mapping _entity_mapping;
+
+		// bucket memory of archetypes created from now on
+		memory_resource* _memory_resource = &memory_resource::default_resource();
+
+		// components with `ecs::sparse_storage`, outside of the archetypes
+		std::array<details::sparse_set, config::registry::sparse_count> _sparse_sets = details::make_sparse_sets(std::make_index_sequence<config::registry::sparse_count>());
 
 		template<bool _Inheritable>
 		static typename world_storage_internal_t<_Inheritable>::create_t create_world_internal(world_vector_t<typename world_storage_internal_t<_Inheritable>::store_t>& worlds);
 
 		std::pair<entity, details::entity_target&> allocate_entity();
 
-		details::archetype_storage<>& runtime_emplace_archetype(size_t bitmask);
+		details::archetype_storage<>& runtime_emplace_archetype(const config::mask_type& bitmask);
+
+		// assigns the index and current tick to a newly created archetype
+		void register_archetype(details::archetype_storage<>& archetype);
+
+		details::archetype_storage<>& archetype_of(const details::entity_target& target) const;
+
+		const details::archetype_edge& emplace_archetype_edge(details::archetype_storage<>& archetype, size_t component, bool add);
+
+		details::sparse_set& sparse_set_of(size_t component);
+
+		template<typename _T>
+		details::sparse_set& sparse_set_of();
+
+		// true if any of the (excluded) components is stored in a sparse set
+		template<typename... _Ts, typename... _Extra>
+		static constexpr bool has_sparse(ecs::pack<_Ts...>, ecs::pack<_Extra...> = {});
 
 		world(world_index_type index);
 
@@ -97,12 +142,57 @@ namespace ecs
 
 		bool erase_entity(entity entity);
 
-		/*template<typename... _Components>
-		inline void reserve_entities(size_t size);*/
+		// Erases all given entities, returns the amount that were alive.
+		// Entities are grouped per archetype and erased in one pass, see `erase_if`.
+		template<typename _Iterator>
+		size_t erase_entities(_Iterator begin, _Iterator end);
+
+		// Erases every qualifying entity for which `func` returns true, returns the amount erased, e.g.:
+		// `world.erase_if([](const Health& health) { return health.value <= 0; });`
+		// Holes are filled from the archetype's tail, consecutive entities are moved as a range and emptied buckets are released whole.
+		template<typename... _Extra, typename _Func>
+		size_t erase_if(_Func&& func);
+
+		// Allocates the buckets and entity ids for `count` more entities of the archetype, e.g.: before a spawn wave
+		template<typename... _Components>
+		void reserve_entities(size_t count);
+
+		// Creates `count` default constructed entities at once and writes their ids to `out`, pass nullptr if they're not needed.
+		// The archetype is looked up once, ids are allocated in bulk and components are constructed row by row.
+		template<typename... _Components, typename _OutputIt = std::nullptr_t>
+		_OutputIt emplace_entities(size_t count, _OutputIt out = nullptr);
+
+		// Erased entities of the archetype leave a dead slot behind instead of having the last entity moved into their place,
+		// other entities keep their order and index. Queries skip the dead slots, `compact` repacks them over time.
+		// Disabling it compacts the archetype at once.
+		template<typename... _Components>
+		void set_stable_erase(bool enable);
+
+		// Repacks the dead slots of stable erase archetypes, visiting at most `budget` slots, e.g.: a few thousand each frame.
+		// Entities keep their order. Returns the amount of dead slots left
+		size_t compact(size_t budget = std::numeric_limits<size_t>::max());
 
 		template<typename _Component, typename... _Args, typename = std::enable_if_t<ecs::config::registry::template contains<_Component> && std::is_constructible_v<_Component, _Args...>>>
 		bool add_entity_component(entity entity, _Args&&... args);
 
+		template<typename _Component, typename = std::enable_if_t<ecs::config::registry::template contains<_Component>>>
+		bool remove_entity_component(entity entity);
+
+		// Removes the component from all given entities, returns the amount of entities that had the component.
+		// Entities are processed per archetype from the back to the front, which keeps the amount of hole filling moves low.
+		template<typename _Component, typename _Iterator, typename = std::enable_if_t<ecs::config::registry::template contains<_Component>>>
+		size_t remove_entities_component(_Iterator begin, _Iterator end);
+
+		// Adds the component to every qualifying entity that doesn't have it yet, each one constructed from `args`, returns the amount of entities changed, e.g.:
+		// `world.add_component_where<Stunned, Enemy, ecs::exclude<Boss>>();`
+		// Whole archetypes move at once, bucket by bucket with a memcpy per column, instead of one entity and archetype lookup at a time.
+		template<typename _Component, typename... _Extra, typename... _Args>
+		size_t add_component_where(const _Args&... args);
+
+		// Removes the component from every qualifying entity that has it, returns the amount of entities changed, see `add_component_where`.
+		template<typename _Component, typename... _Extra>
+		size_t remove_component_where();
+
 		template<typename _T>
 		_T* get_entity_component(entity entity);
 
@@ -115,30 +205,120 @@ namespace ecs
 		template<typename _Arg>
 		static constexpr decltype(auto) forward_argument(size_t i, const details::archetype_storage<>::bucket& bucket, uintptr_t offset);
 
+		template<typename... _Args>
+		static constexpr config::mask_type write_mask(ecs::pack<_Args...>);
+
+		// checks the `changed<T>` and `added<T>` filters of the bucket
+		template<typename... _Extra>
+		static constexpr bool bucket_changed(const details::archetype_storage<>& archetype, size_t bucketIndex, uint32_t since, ecs::pack<_Extra...> = {});
+
 		template<typename _Func, typename... _Args>
-		static constexpr void apply_to_bucket_entities(const details::query_func<_Func, _Args...>& func, size_t count, const details::archetype_storage<>::bucket& bucket, const std::array<uintptr_t, sizeof...(_Args)>& position);
+		static constexpr void apply_to_bucket_entities(const details::query_func<_Func, _Args...>& func, size_t count, const details::archetype_storage<>::bucket& bucket, const std::array<uintptr_t, sizeof...(_Args)>& position, const uint64_t* tombstones = nullptr);
+
+		template<typename _Param>
+		static constexpr decltype(auto) forward_chunk_argument(size_t first, size_t count, details::archetype_storage<>::bucket& bucket, const details::archetype_storage<>& archetype);
+
+		template<typename _Func, typename... _Params, typename... _Extra>
+		void apply_to_qualifying_chunks(_Func& func, ecs::pack<_Params...>, uint32_t since, ecs::pack<_Extra...> = {});
 
 		template<typename _Func, typename... _Args>
-		static constexpr void apply_to_archetype_entities(const details::query_func<_Func, _Args...>& func, details::archetype_storage<>& archetype);
+		static constexpr size_t count_bucket_entities(const details::query_func<_Func, _Args...>& func, size_t count, const details::archetype_storage<>::bucket& bucket, const std::array<uintptr_t, sizeof...(_Args)>& position, const uint64_t* tombstones = nullptr);
+
+		template<typename _Func, typename... _Args, typename... _Extra>
+		static constexpr void apply_to_archetype_entities(const details::query_func<_Func, _Args...>& func, details::archetype_storage<>& archetype, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...> = {});
 
+		// visits the first `size` entities from the last to the first, the current entity may be erased or moved out
 		template<typename _Func, typename... _Args>
-		static constexpr void apply_to_archetype_entities_mutable(const details::query_func<_Func, _Args...>& func, details::archetype_storage<>& archetype);
+		static constexpr void apply_to_archetype_entities_mutable(const details::query_func<_Func, _Args...>& func, details::archetype_storage<>& archetype, size_t size, const config::mask_type& writes);
+
+		template<typename _Func, typename... _Args, typename... _Extra>
+		void apply_to_qualifying_entities(const details::query_func<_Func, _Args...>& func, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...> = {});
+
+		template<typename _Arg>
+		decltype(auto) forward_sparse_argument(uint32_t id, size_t i, const details::archetype_storage<>::bucket& bucket, const details::archetype_storage<>& archetype);
+
+		// joins the archetypes with the sparse sets, calls `visit(archetype, index, id)` for every qualifying entity.
+		// Iterates the smallest included sparse set, or the qualifying archetypes if there's none.
+		template<typename... _Components, typename _Visit, typename... _Extra>
+		void apply_to_sparse_qualifying(_Visit&& visit, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...> = {});
+
+		template<typename _Func, typename... _Args, typename... _Extra>
+		void apply_to_sparse_entities(const details::query_func<_Func, _Args...>& func, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...> = {});
 
 		template<typename _Func, typename... _Args, typename... _Extra>
-		void apply_to_qualifying_entities(const details::query_func<_Func, _Args...>& func, ecs::pack<_Extra...> = {});
+		void apply_to_qualifying_entities_mutable(const details::query_func<_Func, _Args...>& func, const config::mask_type& writes, ecs::pack<_Extra...> = {});
 
+		template<typename... _Args, typename... _Extra>
+		std::vector<std::pair<details::archetype_storage<>*, size_t>> qualifying_buckets(uint32_t since, ecs::pack<_Extra...> = {});
+
+		template<typename _Func, typename... _Args, typename... _Extra>
+		void apply_to_qualifying_entities_parallel(const details::query_func<_Func, _Args...>& func, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...> = {});
+
+		// archetypes with the entities `add_component_where` and `remove_component_where` move, collected before any archetype is created
+		template<typename... _Extra>
+		std::vector<details::archetype_storage<>*> qualifying_archetypes(const config::mask_type& without);
+
+		// appends every qualifying entity for which `func` returns true to `targets`
 		template<typename _Func, typename... _Args, typename... _Extra>
-		void apply_to_qualifying_entities_mutable(const details::query_func<_Func, _Args...>& func, ecs::pack<_Extra...> = {});
+		void collect_qualifying_entities(const details::query_func<_Func, _Args...>& func, std::vector<std::pair<details::entity_target, uint32_t>>& targets, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...> = {});
+
+		// erases the { target, id } entities, which must all be alive, duplicates are allowed
+		size_t erase_targets(std::vector<std::pair<details::entity_target, uint32_t>>& targets);
+
+		template<typename _Func, typename... _Args, typename... _Extra>
+		size_t count_qualifying_entities_parallel(const details::query_func<_Func, _Args...>& func, uint32_t since, ecs::pack<_Extra...> = {});
 
 	public:
+		// Advances the change tick, e.g.: once per frame, returns the new tick
+		uint32_t tick();
+
+		uint32_t current_tick() const;
+
+		// Where archetypes created from now on allocate their buckets, e.g.: a `huge_page_memory_resource`.
+		// Existing archetypes keep theirs, set it before adding entities. The resource must outlive the world.
+		void set_memory_resource(memory_resource& resource);
+
+		memory_resource& get_memory_resource() const;
+
+		// Queries take an optional `since` tick for their `changed<T>` and `added<T>` filters,
+		// buckets that haven't been touched after it are skipped. Defaults to the previous tick.
+		// Sparse components (see `ecs::sparse_storage`) are joined per entity, only `query` and `count` support them.
 		template<typename... _Extra, typename _Func>
 		void query(_Func&& func);
 
+		template<typename... _Extra, typename _Func>
+		void query(uint32_t since, _Func&& func);
+
+		// Same as `query`, but `func` may erase the current entity or change its components.
+		// Archetypes are walked from the last entity to the first, entities moved into other archetypes during the pass aren't visited twice.
 		template<typename... _Extra, typename _Func>
 		void query_mutable(_Func&& func);
 
+		// Calls the lambda once per bucket with the `count` entities of each component row, e.g.:
+		// `world.query_chunks([](size_t count, component_span<Two> two, component_span<const One> one, const entity* ids) {});`
+		// Buckets of stable erase archetypes are handed out as one chunk per run of live entities, dead slots are never included.
+		template<typename... _Extra, typename _Func>
+		void query_chunks(_Func&& func);
+
+		template<typename... _Extra, typename _Func>
+		void query_chunks(uint32_t since, _Func&& func);
+
+		// Same as `query`, but splits the work up in buckets and executes them on the thread pool,
+		// `func` is called concurrently and should therefore not make any structural changes to the world.
+		template<typename... _Extra, typename _Func>
+		void query_parallel(_Func&& func);
+
+		template<typename... _Extra, typename _Func>
+		void query_parallel(uint32_t since, _Func&& func);
+
 		template<typename... _Components>
 		size_t count();
+
+		// Counts all qualifying entities for which `func` returns true, executed on the thread pool.
+		template<typename... _Extra, typename _Func>
+		size_t count_parallel(_Func&& func);
+
+		static details::thread_pool& thread_pool();
 	};
 }
 
@@ -7,6 +7,8 @@
 #include <queue>
 #include <cassert>
 #include <cmath>
+#include <algorithm>
+#include <functional>
 
 #include "entity.h"
 #include "registry.h"
@@ -42,10 +44,13 @@ namespace ecs
 	template <typename>
 	inline world::world(world&& move)
 		: _archetypes(std::move(move._archetypes))
-		, _entity_max(std::move(move._entity_max))
+		, _archetype_lookup(std::move(move._archetype_lookup))
+		, _archetype_indices(std::move(move._archetype_indices))
 		, _world_index(std::move(move._world_index))
+		, _tick(move._tick)
 		, _entity_mapping(std::move(move._entity_mapping))
-		, _entity_mapping_queue(std::move(move._entity_mapping_queue))
+		, _memory_resource(move._memory_resource)
+		, _sparse_sets(std::move(move._sparse_sets))
 	{
 		if constexpr (ecs::config::world_inheritable)
 			_worlds[_world_index] = this;
@@ -93,48 +98,93 @@ namespace ecs
 	template<typename... _Components>
 	inline details::archetype_storage<_Components...>& world::emplace_archetype()
 	{
+		static_assert(!has_sparse(ecs::pack<_Components...>()), "Sparse components are not part of any archetype, add them with `add_entity_component`");
+
 		constexpr auto bitmask = config::registry::template bit_mask_of<_Components...>;
-		for (auto& archetype : _archetypes)
+
+		// per call-site cache of the lookup slot, validated against the key so it's safe across worlds
+		static thread_local size_t slot = decltype(_archetype_lookup)::npos;
+
+		details::archetype_storage<>* archetype = _archetype_lookup.at_slot(slot, bitmask);
+		if (!archetype)
 		{
-			if (archetype.component_mask() == bitmask)
-				return reinterpret_cast<details::archetype_storage<_Components...>&>(archetype);
-		}
+			slot = _archetype_lookup.find_slot(bitmask);
+			if (slot == decltype(_archetype_lookup)::npos)
+			{
+				archetype = &_archetypes.emplace_back();
+				archetype->initialize<_Components...>();
+				register_archetype(*archetype);
 
-		auto& archetype = _archetypes.emplace_back();
-		archetype.initialize<_Components...>();
+				slot = _archetype_lookup.insert(bitmask, archetype);
+			}
+			else
+				archetype = _archetype_lookup.at_slot(slot, bitmask);
+		}
 
-		return reinterpret_cast<details::archetype_storage<_Components...>&>(archetype);
+		return reinterpret_cast<details::archetype_storage<_Components...>&>(*archetype);
 	}
 
-	inline details::archetype_storage<>& world::runtime_emplace_archetype(size_t bitmask)
+	inline details::archetype_storage<>& world::runtime_emplace_archetype(const config::mask_type& bitmask)
 	{
-		for (auto& archetype : _archetypes)
-		{
-			if (archetype.component_mask() == bitmask)
-				return static_cast<details::archetype_storage<>&>(archetype);
-		}
+		if (auto* archetype = _archetype_lookup.find(bitmask))
+			return *archetype;
 
 		auto& archetype = _archetypes.emplace_back();
-		archetype.runtime_initialize(bitmask, config::registry::components());
+		archetype.runtime_initialize(bitmask);
+		register_archetype(archetype);
+		_archetype_lookup.insert(bitmask, &archetype);
 
 		return archetype;
 	}
 
-	inline std::pair<entity, details::entity_target&> world::allocate_entity()
+	inline void world::register_archetype(details::archetype_storage<>& archetype)
 	{
-		uint32_t entity_id;
-		if (_entity_mapping_queue.empty())
-		{
-			entity_id = _entity_max++;
+		assert(_archetype_indices.size() < details::entity_target::npos);
 
-			if (entity_id >= _entity_mapping.size())
-				_entity_mapping.resize(entity_id + 1ull);
-		}
-		else
-		{
-			entity_id = _entity_mapping_queue.front();
-			_entity_mapping_queue.pop();
-		}
+		archetype.set_archetype_index(uint16_t(_archetype_indices.size()));
+		archetype.set_tick(_tick);
+		archetype.set_memory_resource(*_memory_resource);
+		_archetype_indices.push_back(&archetype);
+	}
+
+	inline details::archetype_storage<>& world::archetype_of(const details::entity_target& target) const
+	{
+		return *_archetype_indices[target._archetype];
+	}
+
+	inline const details::archetype_edge& world::emplace_archetype_edge(details::archetype_storage<>& archetype, size_t component, bool add)
+	{
+		if (auto* edge = archetype.find_edge(component, add))
+			return *edge;
+
+		config::mask_type mask = archetype.component_mask();
+
+		auto& target = runtime_emplace_archetype(add ? mask.set(component) : mask.reset(component));
+		return archetype.emplace_edge(component, add, target);
+	}
+
+	inline details::sparse_set& world::sparse_set_of(size_t component)
+	{
+		return _sparse_sets[config::registry::_sparse_index[component]];
+	}
+
+	template<typename _T>
+	inline details::sparse_set& world::sparse_set_of()
+	{
+		static_assert(is_sparse_v<_T>, "Component isn't stored in a sparse set");
+		return _sparse_sets[config::registry::_sparse_index[config::registry::template index_of<_T>]];
+	}
+
+	template<typename... _Ts, typename... _Extra>
+	inline constexpr bool world::has_sparse(ecs::pack<_Ts...>, ecs::pack<_Extra...>)
+	{
+		return (is_sparse_v<decay_change_filter_t<decay_exclude_t<std::decay_t<_Ts>>>> || ...)
+			|| (is_sparse_v<decay_change_filter_t<decay_exclude_t<_Extra>>> || ...);
+	}
+
+	inline std::pair<entity, details::entity_target&> world::allocate_entity()
+	{
+		const uint32_t entity_id = _entity_mapping.allocate();
 
 		auto& mapping = _entity_mapping[entity_id];
 		auto entity_version = mapping._version;
@@ -173,25 +223,179 @@ namespace ecs
 		details::entity_target entity_reference;
 		if (get_entity(entity, entity_reference))
 		{
-			_entity_mapping_queue.push(entity.get_id());
-			_entity_mapping[entity.get_id()].invalidate();
+			for (auto& set : _sparse_sets)
+				set.erase(entity.get_id());
 
-			auto replaced = entity_reference._archetype->erase(entity_reference._index);
+			auto replaced = archetype_of(entity_reference).erase(entity_reference._index);
 			if (replaced != entity::npos)
 				_entity_mapping[replaced].move(entity_reference._index);
 
+			// after the erase, which may report the entity itself as replaced, the free list reuses its target
+			_entity_mapping.free(entity.get_id());
+
 			return true;
 		}
 
 		return false;
 	}
 
-	/*template<typename... _Components>
-	inline void world::reserve_entities(size_t size)
+	template<typename _Iterator>
+	inline size_t world::erase_entities(_Iterator begin, _Iterator end)
+	{
+		std::vector<std::pair<details::entity_target, uint32_t>> targets;
+
+		for (; begin != end; ++begin)
+		{
+			const entity& entity = *begin;
+
+			details::entity_target entity_reference;
+			if (get_entity(entity, entity_reference))
+				targets.emplace_back(entity_reference, entity.get_id());
+		}
+
+		return erase_targets(targets);
+	}
+
+	template<typename... _Extra, typename _Func>
+	inline size_t world::erase_if(_Func&& func)
+	{
+		std::vector<std::pair<details::entity_target, uint32_t>> targets;
+
+		// collect them all first, erasing while iterating would move unvisited entities into visited slots
+		collect_qualifying_entities(details::to_query_func(std::forward<_Func>(func)), targets, write_mask(details::query_params_t<_Func>()), _tick - 1, ecs::pack<_Extra...>());
+
+		return erase_targets(targets);
+	}
+
+	inline size_t world::erase_targets(std::vector<std::pair<details::entity_target, uint32_t>>& targets)
+	{
+		// per archetype by slot, the order in which an archetype fills its holes
+		std::sort(targets.begin(), targets.end(), [](const auto& a, const auto& b)
+		{
+			return a.first._archetype != b.first._archetype
+				? a.first._archetype < b.first._archetype
+				: a.first._index < b.first._index;
+		});
+
+		targets.erase(std::unique(targets.begin(), targets.end(), [](const auto& a, const auto& b) { return a.second == b.second; }), targets.end());
+
+		std::vector<uint32_t> indices;
+		for (size_t t = 0, end = 0; t < targets.size(); t = end)
+		{
+			indices.clear();
+			for (end = t; end < targets.size() && targets[end].first._archetype == targets[t].first._archetype; ++end)
+				indices.push_back(targets[end].first._index);
+
+			archetype_of(targets[t].first).erase(indices.data(), indices.size(), [&](uint32_t id, uint32_t index)
+			{
+				_entity_mapping[id].move(index);
+			});
+		}
+
+		for (auto& [entity_reference, id] : targets)
+		{
+			for (auto& set : _sparse_sets)
+				set.erase(id);
+
+			_entity_mapping.free(id);
+		}
+
+		return targets.size();
+	}
+
+	template<typename... _Components>
+	inline void world::reserve_entities(size_t count)
+	{
+		auto& storage = emplace_archetype<_Components...>();
+		storage.reserve(storage.size() + count);
+
+		_entity_mapping.reserve(_entity_mapping.size() + count);
+	}
+
+	template<typename... _Components>
+	inline void world::set_stable_erase(bool enable)
 	{
-		auto& storage = (details::archetype_storage<bucketSize, _Components...>&)emplace_archetype<_Components...>();
-		storage.reserve(size);
-	}*/
+		auto& archetype = reinterpret_cast<details::archetype_storage<>&>(emplace_archetype<_Components...>());
+
+		// a pass that was already underway may leave dead slots behind it
+		while (!enable && archetype.tombstone_count() > 0)
+		{
+			archetype.compact(std::numeric_limits<size_t>::max(), [&](uint32_t id, uint32_t index)
+			{
+				_entity_mapping[id].move(index);
+			});
+		}
+
+		archetype.set_stable_erase(enable);
+	}
+
+	inline size_t world::compact(size_t budget)
+	{
+		size_t left = 0;
+
+		auto archetype = _archetypes.begin(), endArchetype = _archetypes.end();
+		for (; archetype != endArchetype; ++archetype)
+		{
+			if (archetype->tombstone_count() == 0)
+				continue;
+
+			if (budget > 0)
+			{
+				budget -= archetype->compact(budget, [&](uint32_t id, uint32_t index)
+				{
+					_entity_mapping[id].move(index);
+				});
+			}
+
+			left += archetype->tombstone_count();
+		}
+
+		return left;
+	}
+
+	template<typename... _Components, typename _OutputIt>
+	inline _OutputIt world::emplace_entities(size_t count, _OutputIt out)
+	{
+		auto& storage = reinterpret_cast<details::archetype_storage<>&>(emplace_archetype<_Components...>());
+		storage.grow_to(storage.size() + count);
+
+		uint32_t ids[config::bucket_size];
+		entity entities[config::bucket_size];
+
+		while (count > 0)
+		{
+			// fill up the last bucket at a time
+			const size_t fill = std::min(count, storage.bucket_capacity() - storage.element_index(storage.size()));
+			_entity_mapping.allocate(fill, ids);
+
+			for (size_t i = 0; i < fill; ++i)
+				entities[i] = entity(ids[i], _entity_mapping[ids[i]]._version, _world_index);
+
+			auto [first, bucket] = storage.allocate(entities, fill);
+
+			for (size_t i = 0; i < fill; ++i)
+				_entity_mapping[ids[i]].set(&storage, first + uint32_t(i));
+
+			// construct row by row
+			const size_t element = storage.element_index(first);
+			([&]()
+			{
+				if constexpr (!is_tag_v<_Components>)
+				{
+					auto& row = bucket->get_unsafe<_Components>(storage.component_offset<config::registry::template index_of<_Components>>());
+					for (size_t i = element; i < element + fill; ++i)
+						new (&row[i]) _Components();
+				}
+			}(), ...);
+
+			if constexpr (!std::is_same_v<_OutputIt, std::nullptr_t>)
+				out = std::copy(entities, entities + fill, out);
+
+			count -= fill;
+		}
+
+		return out;
+	}
 
 	template<typename _Component, typename... _Args, typename>
 	inline bool world::add_entity_component(entity entity, _Args&&... args)
@@ -199,17 +403,36 @@ namespace ecs
 		details::entity_target entity_reference;
 		if (get_entity(entity, entity_reference))
 		{
-			auto mask = entity_reference._archetype->component_mask();
-			auto new_mask = mask | ecs::config::registry::template bit_mask_of<_Component>;
+			constexpr size_t componentIndex = ecs::config::registry::template index_of<_Component>;
+
+			// sparse components stay out of the archetype, the entity doesn't move
+			if constexpr (is_sparse_v<_Component>)
+			{
+				static_assert(alignof(_Component) <= alignof(std::max_align_t), "Component alignment is too big for the sparse set storage.");
+
+				auto& set = sparse_set_of<_Component>();
+				if (set.contains(entity.get_id()))
+					return false;
 
-			if (new_mask != mask)
+				void* component = set.allocate(entity.get_id());
+				if constexpr (!is_tag_v<_Component>)
+					new (component) _Component(std::forward<_Args>(args)...);
+
+				return true;
+			}
+			else if (!archetype_of(entity_reference).component_mask().test(ecs::config::registry::template index_of<_Component>))
 			{
-				auto& archetype = runtime_emplace_archetype(new_mask);
-				auto [ newIndex, bucket, replaced ] = entity_reference._archetype->runtime_move(entity_reference._index, archetype,	config::registry::components());
+				auto& edge = emplace_archetype_edge(archetype_of(entity_reference), componentIndex, true);
+				auto& archetype = *edge._target;
+				auto [ newIndex, bucket, replaced ] = archetype_of(entity_reference).move(entity_reference._index, edge);
 
-				size_t component_offset = archetype.component_offset(ecs::config::registry::template index_of<_Component>);
-				auto& component = bucket->get_unsafe<_Component>(component_offset, newIndex % config::bucket_size);
-				new (&component) _Component(std::forward<_Args>(args)...);
+				// tags only change the archetype
+				if constexpr (!is_tag_v<_Component>)
+				{
+					size_t component_offset = archetype.component_offset(componentIndex);
+					auto& component = bucket->get_unsafe<_Component>(component_offset, archetype.element_index(newIndex));
+					new (&component) _Component(std::forward<_Args>(args)...);
+				}
 
 				_entity_mapping[entity.get_id()].move(newIndex, archetype);
 
@@ -223,13 +446,224 @@ namespace ecs
 		return false;
 	}
 		
+	template<typename _Component, typename>
+	inline bool world::remove_entity_component(entity entity)
+	{
+		details::entity_target entity_reference;
+		if constexpr (is_sparse_v<_Component>)
+			return get_entity(entity, entity_reference) && sparse_set_of<_Component>().erase(entity.get_id());
+		else if (get_entity(entity, entity_reference) && archetype_of(entity_reference).component_mask().test(ecs::config::registry::template index_of<_Component>))
+		{
+			auto& edge = emplace_archetype_edge(archetype_of(entity_reference), ecs::config::registry::template index_of<_Component>, false);
+			auto [newIndex, bucket, replaced] = archetype_of(entity_reference).move(entity_reference._index, edge);
+
+			_entity_mapping[entity.get_id()].move(newIndex, *edge._target);
+
+			if (replaced != entity::npos)
+				_entity_mapping[replaced].move(entity_reference._index);
+
+			return true;
+		}
+
+		return false;
+	}
+
+	template<typename _Component, typename _Iterator, typename>
+	inline size_t world::remove_entities_component(_Iterator begin, _Iterator end)
+	{
+		if constexpr (is_sparse_v<_Component>)
+		{
+			size_t count = 0;
+			details::entity_target entity_reference;
+
+			for (; begin != end; ++begin)
+			{
+				const entity& entity = *begin;
+				count += get_entity(entity, entity_reference) && sparse_set_of<_Component>().erase(entity.get_id());
+			}
+
+			return count;
+		}
+		else
+		{
+			std::vector<std::pair<details::entity_target, uint32_t>> targets;
+
+			for (; begin != end; ++begin)
+			{
+				const entity& entity = *begin;
+
+				details::entity_target entity_reference;
+				if (get_entity(entity, entity_reference) && archetype_of(entity_reference).component_mask().test(ecs::config::registry::template index_of<_Component>))
+					targets.emplace_back(entity_reference, entity.get_id());
+			}
+
+			// per archetype, highest index first: every hole is then filled by an entity we don't have to touch again
+			std::sort(targets.begin(), targets.end(), [](const auto& a, const auto& b)
+			{
+				return a.first._archetype != b.first._archetype
+					? a.first._archetype < b.first._archetype
+					: a.first._index > b.first._index;
+			});
+
+			targets.erase(std::unique(targets.begin(), targets.end(), [](const auto& a, const auto& b) { return a.second == b.second; }), targets.end());
+
+			details::archetype_storage<>* archetype = nullptr;
+			const details::archetype_edge* edge = nullptr;
+
+			for (auto& [entity_reference, id] : targets)
+			{
+				if (archetype == nullptr || entity_reference._archetype != archetype->archetype_index())
+				{
+					archetype = &archetype_of(entity_reference);
+					edge = &emplace_archetype_edge(*archetype, ecs::config::registry::template index_of<_Component>, false);
+				}
+
+				auto [newIndex, bucket, replaced] = archetype->move(entity_reference._index, *edge);
+
+				_entity_mapping[id].move(newIndex, *edge->_target);
+
+				if (replaced != entity::npos)
+					_entity_mapping[replaced].move(entity_reference._index);
+			}
+
+			return targets.size();
+		}
+	}
+
+	template<typename... _Extra>
+	inline std::vector<details::archetype_storage<>*> world::qualifying_archetypes(const config::mask_type& without)
+	{
+		static_assert(!(is_change_filter_v<_Extra> || ...), "`changed<T>` and `added<T>` filters are not supported by structural changes");
+
+		std::vector<details::archetype_storage<>*> archetypes;
+
+		auto archetype = _archetypes.begin(), endArchetype = _archetypes.end();
+		for (; archetype != endArchetype; ++archetype)
+		{
+			if (archetype->size() > 0 && !(archetype->component_mask() & without).any() && config::registry::template qualifies<_Extra...>(archetype->component_mask()))
+				archetypes.push_back(&*archetype);
+		}
+
+		return archetypes;
+	}
+
+	template<typename _Component, typename... _Extra, typename... _Args>
+	inline size_t world::add_component_where(const _Args&... args)
+	{
+		static_assert(ecs::config::registry::template contains<_Component> && std::is_constructible_v<_Component, const _Args&...>, "Component isn't registered or can't be constructed from the arguments");
+
+		constexpr size_t componentIndex = ecs::config::registry::template index_of<_Component>;
+		size_t count = 0;
+
+		// sparse components stay out of the archetypes, no entity moves
+		if constexpr (is_sparse_v<_Component>)
+		{
+			static_assert(alignof(_Component) <= alignof(std::max_align_t), "Component alignment is too big for the sparse set storage.");
+
+			std::vector<uint32_t> ids;
+			apply_to_sparse_qualifying<>([&](details::archetype_storage<>&, size_t, uint32_t id) { ids.push_back(id); }, config::mask_type(), 0, ecs::pack<_Extra..., exclude<_Component>>());
+
+			auto& set = sparse_set_of<_Component>();
+			for (uint32_t id : ids)
+			{
+				void* component = set.allocate(id);
+				if constexpr (!is_tag_v<_Component>)
+					new (component) _Component(args...);
+			}
+
+			return ids.size();
+		}
+		else
+		{
+			static_assert(!has_sparse(ecs::pack<_Extra...>()), "Sparse filters are only supported when adding sparse components");
+
+			for (auto* source : qualifying_archetypes<_Extra...>(config::registry::template bit_mask_of<_Component>))
+			{
+				auto& edge = emplace_archetype_edge(*source, componentIndex, true);
+				auto& target = *edge._target;
+				count += source->live_size();
+
+				source->move_all(edge, [&](details::archetype_storage<>::bucket* bucket, uint32_t first, size_t placed)
+				{
+					const size_t element = target.element_index(first);
+
+					// tags only change the archetype
+					if constexpr (!is_tag_v<_Component>)
+					{
+						auto& row = bucket->get_unsafe<_Component>(target.component_offset(componentIndex));
+						for (size_t i = element; i < element + placed; ++i)
+							new (&row[i]) _Component(args...);
+					}
+
+					for (size_t i = 0; i < placed; ++i)
+						_entity_mapping[bucket->get_entity(element + i).get_id()].move(first + uint32_t(i), target);
+				});
+			}
+		}
+
+		return count;
+	}
+
+	template<typename _Component, typename... _Extra>
+	inline size_t world::remove_component_where()
+	{
+		static_assert(ecs::config::registry::template contains<_Component>, "Component isn't registered");
+
+		constexpr size_t componentIndex = ecs::config::registry::template index_of<_Component>;
+		size_t count = 0;
+
+		if constexpr (is_sparse_v<_Component>)
+		{
+			std::vector<uint32_t> ids;
+			apply_to_sparse_qualifying<_Component>([&](details::archetype_storage<>&, size_t, uint32_t id) { ids.push_back(id); }, config::mask_type(), 0, ecs::pack<_Extra...>());
+
+			auto& set = sparse_set_of<_Component>();
+			for (uint32_t id : ids)
+				set.erase(id);
+
+			return ids.size();
+		}
+		else
+		{
+			static_assert(!has_sparse(ecs::pack<_Extra...>()), "Sparse filters are only supported when removing sparse components");
+
+			for (auto* source : qualifying_archetypes<_Component, _Extra...>(config::mask_type()))
+			{
+				auto& edge = emplace_archetype_edge(*source, componentIndex, false);
+				auto& target = *edge._target;
+				count += source->live_size();
+
+				source->move_all(edge, [&](details::archetype_storage<>::bucket* bucket, uint32_t first, size_t placed)
+				{
+					const size_t element = target.element_index(first);
+					for (size_t i = 0; i < placed; ++i)
+						_entity_mapping[bucket->get_entity(element + i).get_id()].move(first + uint32_t(i), target);
+				});
+			}
+		}
+
+		return count;
+	}
+
 	template<typename _T>
 	inline _T* world::get_entity_component(entity entity)
 	{
 		details::entity_target entity_reference;
-		return get_entity(entity, entity_reference)
-			? entity_reference._archetype->get_component<_T>(entity_reference)
-			: nullptr;
+		if constexpr (is_sparse_v<_T>)
+		{
+			if (!get_entity(entity, entity_reference))
+				return nullptr;
+			else if constexpr (is_tag_v<_T>)
+				return sparse_set_of<_T>().contains(entity.get_id()) ? &details::component_row<_T>::_instance : nullptr;
+			else
+				return static_cast<_T*>(sparse_set_of<_T>().find(entity.get_id()));
+		}
+		else
+		{
+			return get_entity(entity, entity_reference)
+				? archetype_of(entity_reference).get_component<_T>(entity_reference)
+				: nullptr;
+		}
 	}
 		
 	template<typename _T>
@@ -245,7 +679,9 @@ namespace ecs
 		if (entity.get_id() < _entity_mapping.size())
 		{
 			target = _entity_mapping[entity.get_id()];
-			return entity._equality == target._version;
+
+			// the mapping only keeps the lower 16 bits of the version
+			return uint16_t(entity.get_version()) == target._version && entity.get_world() == _world_index;
 		}
 
 		return false;
@@ -254,8 +690,11 @@ namespace ecs
 	template<typename _Arg>
 	inline __forceinline constexpr decltype(auto) world::forward_argument(size_t i, const details::archetype_storage<>::bucket& bucket, uintptr_t offset)
 	{
-		uintptr_t matrix = reinterpret_cast<uintptr_t>(&bucket.components());
-		return reinterpret_cast<_Arg*>(matrix + offset)[i];
+		// tags don't touch the bucket at all
+		if constexpr (is_tag_v<_Arg>)
+			return (details::component_row<_Arg>::_instance);
+		else
+			return reinterpret_cast<_Arg*>(reinterpret_cast<uintptr_t>(&bucket) + offset)[i];
 	}
 
 	template<>
@@ -264,120 +703,604 @@ namespace ecs
 		return (bucket.get_entity(i));
 	}
 
+	template<typename... _Args>
+	inline constexpr config::mask_type world::write_mask(ecs::pack<_Args...>)
+	{
+		return (config::mask_type() | ... | (details::is_mutable_param_v<_Args> ? config::registry::template bit_mask_of<std::decay_t<_Args>> : config::mask_type()));
+	}
+
+	template<typename... _Extra>
+	inline __forceinline constexpr bool world::bucket_changed([[maybe_unused]] const details::archetype_storage<>& archetype, [[maybe_unused]] size_t bucketIndex, [[maybe_unused]] uint32_t since, ecs::pack<_Extra...>)
+	{
+		return ([&]() -> bool
+		{
+			constexpr size_t component = config::registry::template index_of<decay_change_filter_t<decay_exclude_t<_Extra>>>;
+
+			if constexpr (is_changed_v<_Extra>)
+				return archetype.changed_since(bucketIndex, component, since);
+			else if constexpr (is_added_v<_Extra>)
+				return archetype.added_since(bucketIndex, component, since);
+			else
+				return true;
+		}() && ...);
+	}
+
 	template<typename _Func, typename... _Args>
-	inline __forceinline constexpr void world::apply_to_bucket_entities(const details::query_func<_Func, _Args...>& func, size_t count, const details::archetype_storage<>::bucket& bucket, const std::array<uintptr_t, sizeof...(_Args)>& position)
+	inline __forceinline constexpr void world::apply_to_bucket_entities(const details::query_func<_Func, _Args...>& func, size_t count, const details::archetype_storage<>::bucket& bucket, const std::array<uintptr_t, sizeof...(_Args)>& position, const uint64_t* tombstones)
 	{
 		typedef registry<_Args...> indexer;
 
-		for (size_t i = 0; i < count; ++i)
+		if (tombstones == nullptr)
 		{
+			for (size_t i = 0; i < count; ++i)
+			{
 #pragma warning( suppress : 28020 ) // MSVC code analyzer shows false positives on std::array[p < n]
-			func(forward_argument<_Args>(i, bucket, position[indexer::template index_of<_Args>])...);
+				func(forward_argument<_Args>(i, bucket, position[indexer::template index_of<_Args>])...);
+			}
+		}
+		else
+		{
+			// bucket with dead slots, only stable erase archetypes have those
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (!details::archetype_storage<>::is_tombstone(tombstones, i))
+				{
+#pragma warning( suppress : 28020 ) // MSVC code analyzer shows false positives on std::array[p < n]
+					func(forward_argument<_Args>(i, bucket, position[indexer::template index_of<_Args>])...);
+				}
+			}
+		}
+	}
+
+	template<typename _Param>
+	inline __forceinline constexpr decltype(auto) world::forward_chunk_argument(size_t first, size_t count, details::archetype_storage<>::bucket& bucket, const details::archetype_storage<>& archetype)
+	{
+		using component = details::chunk_component_t<_Param>;
+		using span = std::remove_cv_t<std::remove_reference_t<_Param>>;
+
+		if constexpr (is_tag_v<component>)
+			return span(nullptr, count);
+		else if constexpr (!std::is_same_v<component, entity>)
+			return span(bucket.get_unsafe<component>(archetype.component_offset<config::registry::template index_of<component>>())._elements + first, count);
+		else if constexpr (std::is_pointer_v<_Param>)
+		{
+			static_assert(std::is_same_v<_Param, const entity*>, "Chunk query entity parameters must be of type `const entity*`");
+			return &bucket.get_entity(first);
+		}
+		else
+		{
+			static_assert(std::is_integral_v<std::decay_t<_Param>>, "Unsupported chunk query parameter, use `size_t`, `component_span<T>` or `const entity*`");
+			return count;
+		}
+	}
+
+	template<typename _Func, typename... _Params, typename... _Extra>
+	inline void world::apply_to_qualifying_chunks(_Func& func, ecs::pack<_Params...>, uint32_t since, ecs::pack<_Extra...>)
+	{
+		static_assert(!has_sparse(ecs::pack<details::chunk_component_t<_Params>...>(), ecs::pack<_Extra...>()), "Sparse components are only supported by `query` and `count`");
+
+		constexpr config::mask_type writes = (config::mask_type() | ... | (details::chunk_writes_v<_Params> ? config::registry::template bit_mask_of<details::chunk_component_t<_Params>> : config::mask_type()));
+
+		auto archetype = _archetypes.begin(), endArchetype = _archetypes.end();
+		for (; archetype != endArchetype; ++archetype)
+		{
+			if (!config::registry::template qualifies<details::chunk_component_t<_Params>...>(archetype->component_mask(), ecs::pack<_Extra...>()))
+				continue;
+
+			auto& buckets = archetype->get_buckets();
+			size_t remaining = archetype->size();
+
+			for (size_t b = 0; remaining > 0; ++b)
+			{
+				const size_t count = std::min(remaining, archetype->bucket_capacity());
+				remaining -= count;
+
+				if constexpr (has_change_filter_v<_Extra...>)
+				{
+					if (!bucket_changed(*archetype, b, since, ecs::pack<_Extra...>()))
+						continue;
+				}
+
+				if constexpr (writes.any())
+					archetype->mark_changed(b, writes);
+
+				const uint64_t* tombstones = archetype->tombstones(b);
+				if (tombstones == nullptr)
+				{
+					func(forward_chunk_argument<_Params>(0, count, *buckets[b], *archetype)...);
+					continue;
+				}
+
+				// bucket with dead slots, only stable erase archetypes have those, each run of live entities is its own chunk
+				for (size_t first = 0; first < count;)
+				{
+					while (first < count && details::archetype_storage<>::is_tombstone(tombstones, first))
+						++first;
+
+					size_t last = first;
+					while (last < count && !details::archetype_storage<>::is_tombstone(tombstones, last))
+						++last;
+
+					if (last > first)
+						func(forward_chunk_argument<_Params>(first, last - first, *buckets[b], *archetype)...);
+
+					first = last;
+				}
+			}
 		}
 	}
 
 	template<typename _Func, typename... _Args>
-	inline __forceinline constexpr void world::apply_to_archetype_entities(const details::query_func<_Func, _Args...>& func, details::archetype_storage<>& archetype)
+	inline __forceinline constexpr size_t world::count_bucket_entities(const details::query_func<_Func, _Args...>& func, size_t count, const details::archetype_storage<>::bucket& bucket, const std::array<uintptr_t, sizeof...(_Args)>& position, const uint64_t* tombstones)
+	{
+		typedef registry<_Args...> indexer;
+
+		size_t matches = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (details::archetype_storage<>::is_tombstone(tombstones, i))
+				continue;
+
+#pragma warning( suppress : 28020 ) // MSVC code analyzer shows false positives on std::array[p < n]
+			matches += bool(func(forward_argument<_Args>(i, bucket, position[indexer::template index_of<_Args>])...));
+		}
+
+		return matches;
+	}
+
+	template<typename _Func, typename... _Args, typename... _Extra>
+	inline __forceinline constexpr void world::apply_to_archetype_entities(const details::query_func<_Func, _Args...>& func, details::archetype_storage<>& archetype, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...>)
 	{
 		const std::array<uintptr_t, sizeof...(_Args)> position{(archetype.component_offset<config::registry::template index_of<_Args>>())...};
-		const size_t lastbucketSize = archetype.size() % config::bucket_size;
+		const size_t lastbucketSize = archetype.element_index(archetype.size());
 
-		auto* bucket = archetype.get_buckets().data();
-		const auto* endbucket = bucket + (archetype.size() / config::bucket_size);
+		auto* const firstbucket = archetype.get_buckets().data();
+		auto* bucket = firstbucket;
+		const auto* endbucket = bucket + archetype.bucket_index(archetype.size());
 
 		for (; bucket < endbucket; ++bucket)
-			apply_to_bucket_entities(func, config::bucket_size, **bucket, position);
+		{
+			if constexpr (has_change_filter_v<_Extra...>)
+			{
+				if (!bucket_changed(archetype, bucket - firstbucket, since, ecs::pack<_Extra...>()))
+					continue;
+			}
+
+			if (writes.any())
+				archetype.mark_changed(bucket - firstbucket, writes);
+
+			apply_to_bucket_entities(func, archetype.bucket_capacity(), **bucket, position, archetype.tombstones(bucket - firstbucket));
+		}
+
+		// apply to the remaining in our last bucket, if it exists
+		if (lastbucketSize > 0 && (!has_change_filter_v<_Extra...> || bucket_changed(archetype, bucket - firstbucket, since, ecs::pack<_Extra...>())))
+		{
+			if (writes.any())
+				archetype.mark_changed(bucket - firstbucket, writes);
 
-		// apply to the remaining in our last bucket, if it doesn't exist then `lastbucketSize` will be 0 and we won't run anything
-		apply_to_bucket_entities(func, lastbucketSize, **bucket, position);
+			apply_to_bucket_entities(func, lastbucketSize, **bucket, position, archetype.tombstones(bucket - firstbucket));
+		}
 	}
 	
 	template<typename _Func, typename... _Args>
-	inline constexpr void world::apply_to_archetype_entities_mutable(const details::query_func<_Func, _Args...>& func, details::archetype_storage<>& archetype)
+	inline constexpr void world::apply_to_archetype_entities_mutable(const details::query_func<_Func, _Args...>& func, details::archetype_storage<>& archetype, size_t size, const config::mask_type& writes)
 	{
 		typedef registry<_Args...> indexer;
 
-		if (archetype.size() == 0)
+		size_t end = std::min(size, archetype.size());
+		if (end == 0)
 			return;
 
 		const std::array<uintptr_t, sizeof...(_Args)> position{ (archetype.component_offset<config::registry::template index_of<_Args>>())... };
 
-		auto* bucket = archetype.get_buckets().data();
+		// entities may move around while we iterate, mark all buckets up front
+		if (writes.any())
+		{
+			for (size_t b = 0, bucketCount = archetype.bucket_count(); b < bucketCount; ++b)
+				archetype.mark_changed(b, writes);
+		}
 
-		for (size_t count = 0, i = 0; ; )
+		const bool stable = archetype.stable_erase();
+
+		// tail to head: an entity that's erased or moved out is replaced by the last one, which has been visited already
+		while (end > 0)
 		{
-			const entity& ent = (*bucket)->get_entity(i);
-			auto prevId = ent.get_id();
+			const size_t bucketIndex = archetype.bucket_index(end - 1);
+			const size_t first = bucketIndex * archetype.bucket_capacity();
 
-#pragma warning( suppress : 28020 ) // MSVC code analyzer shows false positives on std::array[p < n]
-			func(forward_argument<_Args>(i, **bucket, position[indexer::template index_of<_Args>])...);
+			// bucket memory stays put while entities are added or removed, it's only released once the archetype shrinks below it
+			const auto& bucket = *archetype.get_buckets()[bucketIndex];
 
-			if (count >= archetype.size())
-				return;
-			else if (prevId == ent.get_id())
+			size_t i = end - first;
+			for (; i > 0; --i)
 			{
-				if (++count >= archetype.size())
-					return;
+				const size_t element = i - 1;
+				if (stable && archetype.is_tombstone(first + element))
+					continue;
+
+#pragma warning( suppress : 28020 ) // MSVC code analyzer shows false positives on std::array[p < n]
+				func(forward_argument<_Args>(element, bucket, position[indexer::template index_of<_Args>])...);
 
-				if (++i >= config::bucket_size)
+				// more than the current entity has been erased, continue from the new end
+				if (archetype.size() < first + element)
 				{
-					i = 0;
-					++bucket;
+					i = element;
+					break;
 				}
 			}
+
+			end = std::min(first + i, archetype.size());
 		}
 	}
 
 	template<typename _Func, typename... _Args, typename... _Extra>
-	inline void world::apply_to_qualifying_entities(const details::query_func<_Func, _Args...>& func, ecs::pack<_Extra...>)
+	inline void world::apply_to_qualifying_entities(const details::query_func<_Func, _Args...>& func, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...>)
 	{
 		// cache it, preventing .end() rereads on each iteration
 		auto archetype = _archetypes.begin(), endArchetype = _archetypes.end();
 		for (; archetype != endArchetype; ++archetype)
 		{
 			if (config::registry::template qualifies<_Args...>(archetype->component_mask(), ecs::pack<_Extra...>()))
-				apply_to_archetype_entities(func, *archetype);
+				apply_to_archetype_entities(func, *archetype, writes, since, ecs::pack<_Extra...>());
+		}
+	}
+
+	template<typename _Arg>
+	inline __forceinline decltype(auto) world::forward_sparse_argument(uint32_t id, size_t i, const details::archetype_storage<>::bucket& bucket, const details::archetype_storage<>& archetype)
+	{
+		if constexpr (is_entity_v<_Arg>)
+			return (bucket.get_entity(i));
+		else if constexpr (is_tag_v<_Arg>)
+			return (details::component_row<_Arg>::_instance);
+		else if constexpr (is_sparse_v<_Arg>)
+			return *static_cast<_Arg*>(sparse_set_of<_Arg>().find(id));
+		else
+			return forward_argument<_Arg>(i, bucket, archetype.component_offset<config::registry::template index_of<_Arg>>());
+	}
+
+	template<typename... _Components, typename _Visit, typename... _Extra>
+	inline void world::apply_to_sparse_qualifying(_Visit&& visit, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...>)
+	{
+		static_assert(!((is_change_filter_v<_Extra> && is_sparse_v<decay_change_filter_t<_Extra>>) || ...), "`changed<T>` and `added<T>` filters are not supported on sparse components");
+
+		constexpr config::mask_type include = (config::registry::template bit_mask_of<_Components...> | config::registry::template bit_mask_of<_Extra...>) & config::registry::sparse_mask;
+		constexpr config::mask_type exclude = config::registry::template bit_mask_of<decay_exclude_t<_Extra>...> & config::registry::sparse_mask & ~include;
+
+		std::array<const details::sparse_set*, config::registry::sparse_count> includes, excludes;
+		size_t includeCount = 0, excludeCount = 0;
+
+		for (auto& set : _sparse_sets)
+		{
+			if (include.test(set.component()))
+				includes[includeCount++] = &set;
+			else if (exclude.test(set.component()))
+				excludes[excludeCount++] = &set;
+		}
+
+		// the smallest set drives the iteration, the others are only probed
+		if (includeCount > 1)
+			std::iter_swap(includes.begin(), std::min_element(includes.begin(), includes.begin() + includeCount, [](auto a, auto b) { return a->size() < b->size(); }));
+
+		details::archetype_storage<>* archetype = nullptr;
+		bool qualified = false;
+		size_t marked = ~size_t(0);
+
+		auto visitEntity = [&](details::archetype_storage<>& current, size_t index, uint32_t id)
+		{
+			for (size_t s = 1; s < includeCount; ++s)
+			{
+				if (!includes[s]->contains(id))
+					return;
+			}
+
+			for (size_t s = 0; s < excludeCount; ++s)
+			{
+				if (excludes[s]->contains(id))
+					return;
+			}
+
+			if (&current != archetype)
+			{
+				archetype = &current;
+				qualified = config::registry::template qualifies<_Components...>(current.component_mask(), ecs::pack<_Extra...>());
+				marked = ~size_t(0);
+			}
+
+			const size_t bucketIndex = current.bucket_index(index);
+			if (!qualified || (has_change_filter_v<_Extra...> && !bucket_changed(current, bucketIndex, since, ecs::pack<_Extra...>())))
+				return;
+
+			if (writes.any() && bucketIndex != marked)
+			{
+				current.mark_changed(bucketIndex, writes);
+				marked = bucketIndex;
+			}
+
+			visit(current, index, id);
+		};
+
+		if (includeCount > 0)
+		{
+			const details::sparse_set& driver = *includes[0];
+			for (size_t d = 0; d < driver.size(); ++d)
+			{
+				const uint32_t id = driver.id(d);
+				const details::entity_target& target = _entity_mapping[id];
+				visitEntity(archetype_of(target), target._index, id);
+			}
+		}
+		else
+		{
+			auto current = _archetypes.begin(), endArchetype = _archetypes.end();
+			for (; current != endArchetype; ++current)
+			{
+				if (!config::registry::template qualifies<_Components...>(current->component_mask(), ecs::pack<_Extra...>()))
+					continue;
+
+				auto& buckets = current->get_buckets();
+				for (size_t index = 0, size = current->size(); index < size; ++index)
+				{
+					if (!current->is_tombstone(index))
+						visitEntity(*current, index, buckets[current->bucket_index(index)]->get_entity(current->element_index(index)).get_id());
+				}
+			}
 		}
 	}
 
 	template<typename _Func, typename... _Args, typename... _Extra>
-	inline void world::apply_to_qualifying_entities_mutable(const details::query_func<_Func, _Args...>& func, ecs::pack<_Extra...>)
+	inline void world::apply_to_sparse_entities(const details::query_func<_Func, _Args...>& func, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...>)
 	{
-		// TODO: ignore any moved entities to archetypes later in the chain
-		
-		// cache it, preventing .end() rereads on each iteration
+		apply_to_sparse_qualifying<_Args...>([&](details::archetype_storage<>& archetype, size_t index, uint32_t id)
+		{
+			const auto& bucket = *archetype.get_buckets()[archetype.bucket_index(index)];
+			const size_t i = archetype.element_index(index);
+
+			func(forward_sparse_argument<_Args>(id, i, bucket, archetype)...);
+		}, writes, since, ecs::pack<_Extra...>());
+	}
+
+	template<typename _Func, typename... _Args, typename... _Extra>
+	inline void world::apply_to_qualifying_entities_mutable(const details::query_func<_Func, _Args...>& func, const config::mask_type& writes, ecs::pack<_Extra...>)
+	{
+		static_assert(!(is_change_filter_v<_Extra> || ...), "`changed<T>` and `added<T>` filters are not supported by `query_mutable`");
+
+		// snapshot of the qualifying archetypes and their sizes, entities moved into later (or new) archetypes during the pass aren't visited again
+		std::vector<std::pair<details::archetype_storage<>*, size_t>> archetypes;
+
+		auto archetype = _archetypes.begin(), endArchetype = _archetypes.end();
+		for (; archetype != endArchetype; ++archetype)
+		{
+			if (archetype->size() > 0 && config::registry::template qualifies<_Args...>(archetype->component_mask(), ecs::pack<_Extra...>()))
+				archetypes.emplace_back(&*archetype, archetype->size());
+		}
+
+		for (auto& [qualifying, size] : archetypes)
+			apply_to_archetype_entities_mutable(func, *qualifying, size, writes);
+	}
+
+	template<typename... _Args, typename... _Extra>
+	inline std::vector<std::pair<details::archetype_storage<>*, size_t>> world::qualifying_buckets(uint32_t since, ecs::pack<_Extra...>)
+	{
+		std::vector<std::pair<details::archetype_storage<>*, size_t>> buckets;
+
 		auto archetype = _archetypes.begin(), endArchetype = _archetypes.end();
 		for (; archetype != endArchetype; ++archetype)
 		{
 			if (config::registry::template qualifies<_Args...>(archetype->component_mask(), ecs::pack<_Extra...>()))
-				apply_to_archetype_entities_mutable(func, *archetype);
+			{
+				const size_t bucketCount = archetype->bucket_count();
+				for (size_t i = 0; i < bucketCount; ++i)
+				{
+					if (!has_change_filter_v<_Extra...> || bucket_changed(*archetype, i, since, ecs::pack<_Extra...>()))
+						buckets.emplace_back(&*archetype, i);
+				}
+			}
 		}
+
+		return buckets;
+	}
+
+	template<typename _Func, typename... _Args, typename... _Extra>
+	inline void world::apply_to_qualifying_entities_parallel(const details::query_func<_Func, _Args...>& func, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...>)
+	{
+		const auto buckets = qualifying_buckets<_Args...>(since, ecs::pack<_Extra...>());
+
+		thread_pool().run(buckets.size(), [&](size_t task)
+		{
+			auto [archetype, bucketIndex] = buckets[task];
+
+			const std::array<uintptr_t, sizeof...(_Args)> position{ (archetype->template component_offset<config::registry::template index_of<_Args>>())... };
+			const size_t count = archetype->bucket_entity_count(bucketIndex);
+
+			// buckets are spread over the tasks, so are their ticks
+			if (writes.any())
+				archetype->mark_changed(bucketIndex, writes);
+
+			apply_to_bucket_entities(func, count, *archetype->get_buckets()[bucketIndex], position, archetype->tombstones(bucketIndex));
+		});
+	}
+
+	template<typename _Func, typename... _Args, typename... _Extra>
+	inline void world::collect_qualifying_entities(const details::query_func<_Func, _Args...>& func, std::vector<std::pair<details::entity_target, uint32_t>>& targets, const config::mask_type& writes, uint32_t since, ecs::pack<_Extra...>)
+	{
+		if constexpr (has_sparse(ecs::pack<_Args...>(), ecs::pack<_Extra...>()))
+		{
+			apply_to_sparse_qualifying<_Args...>([&](details::archetype_storage<>& archetype, size_t index, uint32_t id)
+			{
+				const auto& bucket = *archetype.get_buckets()[archetype.bucket_index(index)];
+				const size_t i = archetype.element_index(index);
+
+				if (func(forward_sparse_argument<_Args>(id, i, bucket, archetype)...))
+					targets.push_back({ details::entity_target{ uint32_t(index), archetype.archetype_index(), 0 }, id });
+			}, writes, since, ecs::pack<_Extra...>());
+		}
+		else
+		{
+			typedef registry<_Args...> indexer;
+
+			auto archetype = _archetypes.begin(), endArchetype = _archetypes.end();
+			for (; archetype != endArchetype; ++archetype)
+			{
+				if (!config::registry::template qualifies<_Args...>(archetype->component_mask(), ecs::pack<_Extra...>()))
+					continue;
+
+				const std::array<uintptr_t, sizeof...(_Args)> position{ (archetype->template component_offset<config::registry::template index_of<_Args>>())... };
+
+				for (size_t b = 0, bucketCount = archetype->bucket_count(); b < bucketCount; ++b)
+				{
+					if constexpr (has_change_filter_v<_Extra...>)
+					{
+						if (!bucket_changed(*archetype, b, since, ecs::pack<_Extra...>()))
+							continue;
+					}
+
+					if (writes.any())
+						archetype->mark_changed(b, writes);
+
+					const auto& bucket = *archetype->get_buckets()[b];
+					const size_t first = b * archetype->bucket_capacity();
+					const uint64_t* tombstones = archetype->tombstones(b);
+
+					for (size_t i = 0, count = archetype->bucket_entity_count(b); i < count; ++i)
+					{
+						if (details::archetype_storage<>::is_tombstone(tombstones, i))
+							continue;
+
+#pragma warning( suppress : 28020 ) // MSVC code analyzer shows false positives on std::array[p < n]
+						if (func(forward_argument<_Args>(i, bucket, position[indexer::template index_of<_Args>])...))
+							targets.push_back({ details::entity_target{ uint32_t(first + i), archetype->archetype_index(), 0 }, bucket.get_entity(i).get_id() });
+					}
+				}
+			}
+		}
+	}
+
+	template<typename _Func, typename... _Args, typename... _Extra>
+	inline size_t world::count_qualifying_entities_parallel(const details::query_func<_Func, _Args...>& func, uint32_t since, ecs::pack<_Extra...>)
+	{
+		const auto buckets = qualifying_buckets<_Args...>(since, ecs::pack<_Extra...>());
+		std::atomic<size_t> matches = 0;
+
+		thread_pool().run(buckets.size(), [&](size_t task)
+		{
+			auto [archetype, bucketIndex] = buckets[task];
+
+			const std::array<uintptr_t, sizeof...(_Args)> position{ (archetype->template component_offset<config::registry::template index_of<_Args>>())... };
+			const size_t count = archetype->bucket_entity_count(bucketIndex);
+
+			// one atomic operation per bucket, keeps contention low
+			matches.fetch_add(count_bucket_entities(func, count, *archetype->get_buckets()[bucketIndex], position, archetype->tombstones(bucketIndex)), std::memory_order_relaxed);
+		});
+
+		return matches.load(std::memory_order_relaxed);
+	}
+
+	inline uint32_t world::tick()
+	{
+		++_tick;
+
+		auto archetype = _archetypes.begin(), endArchetype = _archetypes.end();
+		for (; archetype != endArchetype; ++archetype)
+			archetype->set_tick(_tick);
+
+		return _tick;
+	}
+
+	inline uint32_t world::current_tick() const
+	{
+		return _tick;
+	}
+
+	inline void world::set_memory_resource(memory_resource& resource)
+	{
+		_memory_resource = &resource;
+	}
+
+	inline memory_resource& world::get_memory_resource() const
+	{
+		return *_memory_resource;
 	}
 
 	template<typename... _Extra, typename _Func>
 	inline void world::query(_Func&& func)
 	{
-		apply_to_qualifying_entities(details::to_query_func(std::forward<_Func>(func)), ecs::pack<_Extra...>());
+		query<_Extra...>(_tick - 1, std::forward<_Func>(func));
+	}
+
+	template<typename... _Extra, typename _Func>
+	inline void world::query(uint32_t since, _Func&& func)
+	{
+		auto queryFunc = details::to_query_func(std::forward<_Func>(func));
+
+		if constexpr (has_sparse(details::query_params_t<_Func>(), ecs::pack<_Extra...>()))
+			apply_to_sparse_entities(queryFunc, write_mask(details::query_params_t<_Func>()), since, ecs::pack<_Extra...>());
+		else
+			apply_to_qualifying_entities(queryFunc, write_mask(details::query_params_t<_Func>()), since, ecs::pack<_Extra...>());
 	}
 
 	template<typename... _Extra, typename _Func>
 	inline void world::query_mutable(_Func&& func)
 	{
-		apply_to_qualifying_entities_mutable(details::to_query_func(std::forward<_Func>(func)), ecs::pack<_Extra...>());
+		static_assert(!has_sparse(details::query_params_t<_Func>(), ecs::pack<_Extra...>()), "Sparse components are only supported by `query` and `count`");
+		apply_to_qualifying_entities_mutable(details::to_query_func(std::forward<_Func>(func)), write_mask(details::query_params_t<_Func>()), ecs::pack<_Extra...>());
 	}
 	
+	template<typename... _Extra, typename _Func>
+	inline void world::query_chunks(_Func&& func)
+	{
+		query_chunks<_Extra...>(_tick - 1, std::forward<_Func>(func));
+	}
+
+	template<typename... _Extra, typename _Func>
+	inline void world::query_chunks(uint32_t since, _Func&& func)
+	{
+		apply_to_qualifying_chunks(func, details::query_params_t<_Func>(), since, ecs::pack<_Extra...>());
+	}
+
+	template<typename... _Extra, typename _Func>
+	inline void world::query_parallel(_Func&& func)
+	{
+		query_parallel<_Extra...>(_tick - 1, std::forward<_Func>(func));
+	}
+
+	template<typename... _Extra, typename _Func>
+	inline void world::query_parallel(uint32_t since, _Func&& func)
+	{
+		static_assert(!has_sparse(details::query_params_t<_Func>(), ecs::pack<_Extra...>()), "Sparse components are only supported by `query` and `count`");
+		apply_to_qualifying_entities_parallel(details::to_query_func(std::forward<_Func>(func)), write_mask(details::query_params_t<_Func>()), since, ecs::pack<_Extra...>());
+	}
+
 	template<typename... _Extra>
 	inline size_t world::count()
 	{
 		size_t count = 0;
 
+		if constexpr (has_sparse(ecs::pack<_Extra...>()))
+		{
+			apply_to_sparse_qualifying<>([&](details::archetype_storage<>&, size_t, uint32_t) { ++count; }, config::mask_type(), 0, ecs::pack<_Extra...>());
+			return count;
+		}
+
 		auto archetype = _archetypes.begin(), endArchetype = _archetypes.end();
 		for (; archetype != endArchetype; ++archetype)
 		{
 			if (config::registry::template qualifies<_Extra...>(archetype->component_mask()))
-				count += archetype->size();
+				count += archetype->live_size();
 		}
 
 		return count;
 	}
+
+	template<typename... _Extra, typename _Func>
+	inline size_t world::count_parallel(_Func&& func)
+	{
+		static_assert(!has_sparse(details::query_params_t<_Func>(), ecs::pack<_Extra...>()), "Sparse components are only supported by `query` and `count`");
+		return count_qualifying_entities_parallel(details::to_query_func(std::forward<_Func>(func)), _tick - 1, ecs::pack<_Extra...>());
+	}
+
+	inline details::thread_pool& world::thread_pool()
+	{
+		static details::thread_pool pool(config::thread_count);
+		return pool;
+	}
 }